@@ -33,6 +33,9 @@ public:
     const Edge<Weight>& GetEdge(EdgeId edge_id) const;
     IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
 
+    // Память, занимаемая рёбрами и списками смежности
+    size_t GetMemoryUsage() const;
+
 private:
     std::vector<Edge<Weight>> edges_;
     std::vector<IncidenceList> incidence_lists_;
@@ -71,4 +74,14 @@ typename DirectedWeightedGraph<Weight>::IncidentEdgesRange
 DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
     return ranges::AsRange(incidence_lists_.at(vertex));
 }
+
+template <typename Weight>
+size_t DirectedWeightedGraph<Weight>::GetMemoryUsage() const {
+    size_t bytes = edges_.capacity() * sizeof(Edge<Weight>)
+                   + incidence_lists_.capacity() * sizeof(IncidenceList);
+    for (const auto& incidence_list : incidence_lists_) {
+        bytes += incidence_list.capacity() * sizeof(EdgeId);
+    }
+    return bytes;
+}
 }  // namespace graph
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include "instrumentation.h"
+
+#include "json.h"
+#include "json_builder.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace instrumentation {
+
+namespace {
+
+double ToMicroseconds(std::chrono::nanoseconds duration) {
+    return static_cast<double>(duration.count()) / 1000.0;
+}
+
+}  // namespace
+
+size_t LatencyHistogram::ToBucketIndex(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value);
+    }
+    // Сдвиг, после которого значение попадает в [SUB_BUCKET_COUNT, 2 * SUB_BUCKET_COUNT)
+    const int shift = std::bit_width(value) - SUB_BUCKET_BITS - 1;
+    return static_cast<size_t>((shift + 1) * SUB_BUCKET_COUNT + ((value >> shift) - SUB_BUCKET_COUNT));
+}
+
+uint64_t LatencyHistogram::FromBucketIndex(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    const int shift = static_cast<int>(index / SUB_BUCKET_COUNT) - 1;
+    const uint64_t sub_bucket = index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(std::chrono::nanoseconds duration) {
+    const uint64_t value = static_cast<uint64_t>(std::max<std::chrono::nanoseconds::rep>(duration.count(), 0));
+    counts_[ToBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_ns_.fetch_add(value, std::memory_order_relaxed);
+    for (uint64_t max = max_ns_.load(std::memory_order_relaxed);
+         value > max && !max_ns_.compare_exchange_weak(max, value, std::memory_order_relaxed);) {
+    }
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetTotal() const {
+    return std::chrono::nanoseconds(total_ns_.load(std::memory_order_relaxed));
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetMax() const {
+    return std::chrono::nanoseconds(max_ns_.load(std::memory_order_relaxed));
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetValueAtPercentile(double percentile) const {
+    const uint64_t count = GetCount();
+    if (count == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(count))));
+    uint64_t seen = 0;
+    for (size_t index = 0; index < BUCKET_COUNT; ++index) {
+        seen += counts_[index].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // Верхняя граница интервала не должна превышать реальный максимум
+            return std::min(std::chrono::nanoseconds(FromBucketIndex(index)), GetMax());
+        }
+    }
+    return GetMax();
+}
+
+Registry& Registry::Instance() {
+    static Registry registry;
+    return registry;
+}
+
+LatencyHistogram& Registry::GetOrAdd(Histograms& histograms, std::string_view name) {
+    auto it = histograms.find(name);
+    if (it == histograms.end()) {
+        it = histograms.emplace(std::string(name), std::make_unique<LatencyHistogram>()).first;
+    }
+    return *it->second;
+}
+
+LatencyHistogram& Registry::Phase(std::string_view name) {
+    std::lock_guard lock(mutex_);
+    return GetOrAdd(phases_, name);
+}
+
+LatencyHistogram& Registry::Request(std::string_view type) {
+    std::lock_guard lock(mutex_);
+    return GetOrAdd(requests_, type);
+}
+
+void Registry::PrintReport(std::ostream& output, const memory::Report* memory_usage) const {
+    std::lock_guard lock(mutex_);
+    json::Builder report;
+    report.StartDict()
+          .Key("instrumentation_enabled").Value(static_cast<bool>(TC_INSTRUMENTATION));
+
+    // Этапы: сколько раз выполнялись и сколько времени заняли
+    report.Key("phases").StartDict();
+    for (const auto& [name, histogram] : phases_) {
+        report.Key(name).StartDict()
+                  .Key("count").Value(static_cast<int>(histogram->GetCount()))
+                  .Key("total_us").Value(ToMicroseconds(histogram->GetTotal()))
+                  .Key("max_us").Value(ToMicroseconds(histogram->GetMax()))
+              .EndDict();
+    }
+    report.EndDict();
+
+    // Запросы: распределение задержек по типам
+    report.Key("requests").StartDict();
+    for (const auto& [type, histogram] : requests_) {
+        const uint64_t count = histogram->GetCount();
+        if (count == 0) {
+            continue;
+        }
+        report.Key(type).StartDict()
+                  .Key("count").Value(static_cast<int>(count))
+                  .Key("mean_us").Value(ToMicroseconds(histogram->GetTotal()) / static_cast<double>(count))
+                  .Key("p50_us").Value(ToMicroseconds(histogram->GetValueAtPercentile(50.0)))
+                  .Key("p90_us").Value(ToMicroseconds(histogram->GetValueAtPercentile(90.0)))
+                  .Key("p99_us").Value(ToMicroseconds(histogram->GetValueAtPercentile(99.0)))
+                  .Key("p999_us").Value(ToMicroseconds(histogram->GetValueAtPercentile(99.9)))
+                  .Key("max_us").Value(ToMicroseconds(histogram->GetMax()))
+              .EndDict();
+    }
+    report.EndDict();
+
+    // Память по подсистемам на момент выхода
+    if (memory_usage) {
+        report.Key("memory_kib").StartDict();
+        for (const auto& [name, bytes] : memory_usage->GetEntries()) {
+            report.Key(name).Value(memory::ToKibibytes(bytes));
+        }
+        report.Key("total").Value(memory::ToKibibytes(memory_usage->GetTotal())).EndDict();
+    }
+
+    json::Print(json::Document(report.EndDict().Build()), output);
+    output << std::endl;
+}
+
+}  // namespace instrumentation
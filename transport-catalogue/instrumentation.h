@@ -0,0 +1,118 @@
+#pragma once
+
+#include "memory_accounting.h"
+#include "tracing.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+/*
+ * Встроенная инструментация: таймеры этапов запуска и гистограммы задержек запросов.
+ *
+ * Включается при сборке макросом TC_INSTRUMENTATION (по умолчанию 1).
+ * При TC_INSTRUMENTATION=0 макросы TC_TIMED_SCOPE/TC_PHASE_SCOPE (и трассировки) раскрываются в пустой оператор,
+ * их аргументы не вычисляются, и инструментация ничего не стоит.
+ */
+
+#ifndef TC_INSTRUMENTATION
+#define TC_INSTRUMENTATION 1
+#endif
+
+namespace instrumentation {
+
+// Гистограмма задержек в стиле HDR: логарифмические интервалы, каждый поделён на
+// 2^SUB_BUCKET_BITS равных частей, поэтому относительная погрешность не больше 1/32.
+// Запись без блокировок, можно вызывать из нескольких потоков
+class LatencyHistogram {
+public:
+    void Record(std::chrono::nanoseconds duration);
+
+    uint64_t GetCount() const;
+    std::chrono::nanoseconds GetTotal() const;
+    std::chrono::nanoseconds GetMax() const;
+    // percentile в диапазоне [0, 100]; для пустой гистограммы возвращает 0
+    std::chrono::nanoseconds GetValueAtPercentile(double percentile) const;
+
+private:
+    static constexpr int SUB_BUCKET_BITS = 5;
+    static constexpr uint64_t SUB_BUCKET_COUNT = uint64_t{1} << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    static size_t ToBucketIndex(uint64_t value);
+    // Наибольшее значение, попадающее в интервал
+    static uint64_t FromBucketIndex(size_t index);
+
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> counts_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> total_ns_{0};
+    std::atomic<uint64_t> max_ns_{0};
+};
+
+// Именованные гистограммы этапов и типов запросов (общие для процесса)
+class Registry {
+public:
+    static Registry& Instance();
+
+    // Ссылки на гистограммы действительны до конца работы программы
+    LatencyHistogram& Phase(std::string_view name);
+    LatencyHistogram& Request(std::string_view type);
+
+    // Печатает отчёт в формате JSON; memory_usage, если задан, попадает в раздел memory_kib
+    void PrintReport(std::ostream& output, const memory::Report* memory_usage = nullptr) const;
+
+private:
+    using Histograms = std::map<std::string, std::unique_ptr<LatencyHistogram>, std::less<>>;
+
+    static LatencyHistogram& GetOrAdd(Histograms& histograms, std::string_view name);
+
+    mutable std::mutex mutex_;
+    Histograms phases_;
+    Histograms requests_;
+};
+
+// Записывает в гистограмму время жизни объекта
+class ScopedTimer {
+public:
+    explicit ScopedTimer(LatencyHistogram& histogram)
+        : histogram_(histogram)
+        , start_(std::chrono::steady_clock::now())
+    {}
+
+    ~ScopedTimer() {
+        histogram_.Record(std::chrono::steady_clock::now() - start_);
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    LatencyHistogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace instrumentation
+
+#define TC_INSTRUMENTATION_CONCAT_IMPL(a, b) a##b
+#define TC_INSTRUMENTATION_CONCAT(a, b) TC_INSTRUMENTATION_CONCAT_IMPL(a, b)
+
+#if TC_INSTRUMENTATION
+// Замеряет время до конца текущей области видимости
+#define TC_TIMED_SCOPE(histogram) \
+    ::instrumentation::ScopedTimer TC_INSTRUMENTATION_CONCAT(tc_scoped_timer_, __LINE__)(histogram)
+// Этап попадает и в таймеры отчёта, и в трассировку
+#define TC_PHASE_SCOPE(name) \
+    TC_TIMED_SCOPE(::instrumentation::Registry::Instance().Phase(name)); \
+    TC_TRACE_SCOPE(name)
+#else
+#define TC_TIMED_SCOPE(histogram) static_cast<void>(0)
+#define TC_PHASE_SCOPE(name) static_cast<void>(0)
+#endif
@@ -1,8 +1,23 @@
 #include "json.h"
 
+#include "memory_accounting.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <exception>
+#include <iterator>
 #include <stdexcept>
+#include <streambuf>
+#include <thread>
 #include <unordered_set>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 
 namespace json {
@@ -215,10 +230,185 @@ Node LoadNode(istream& input) {
     }
 }
 
+
+// ---------- Parallel loading ------------------
+
+// Буфер потока поверх уже прочитанного текста (без копирования)
+class MemoryBuffer : public std::streambuf {
+public:
+    MemoryBuffer(const char* begin, const char* end) {
+        setg(const_cast<char*>(begin), const_cast<char*>(begin), const_cast<char*>(end));
+    }
+};
+
+// Член корневого словаря, найденный структурным предварительным проходом
+struct RootMember {
+    const char* key = nullptr;          // символ после открывающей кавычки ключа
+    const char* value_begin = nullptr;  // символ после ':'
+    const char* value_end = nullptr;    // ',' или '}' после значения
+    bool is_array = false;
+    // Для массивов: позиции '[', разделяющих ',' и ']'; элемент i лежит между separators[i] и separators[i + 1]
+    std::vector<const char*> separators;
+};
+
+// Находит члены корневого словаря и границы элементов его массивов, не разбирая значения
+std::vector<RootMember> ScanRootMembers(const char* begin, const char* end) {
+    std::vector<RootMember> members;
+    RootMember member;
+    int depth = 0;
+    char nested_container = '\0';
+    bool in_string = false;
+    bool is_escaped = false;
+    for (const char* pos = begin; pos != end; ++pos) {
+        const char c = *pos;
+        if (in_string) {
+            if (is_escaped) {
+                is_escaped = false;
+            } else if (c == '\\') {
+                is_escaped = true;
+            } else if (c == '"') {
+                in_string = false;
+            }
+            continue;
+        }
+
+        switch (c) {
+        case '"':
+            in_string = true;
+            if (depth == 1 && !member.key) {
+                member.key = pos + 1;
+            }
+            break;
+        case ':':
+            if (depth == 1 && !member.value_begin) {
+                member.value_begin = pos + 1;
+            }
+            break;
+        case '{':
+        case '[':
+            ++depth;
+            if (depth == 1 && c != '{') {
+                throw json::ParsingError("parallel load failed: root is not dict");
+            }
+            if (depth == 2) {
+                nested_container = c;
+                if (c == '[') {
+                    member.is_array = true;
+                    member.separators.push_back(pos);
+                }
+            }
+            break;
+        case ',':
+            if (depth == 2 && nested_container == '[') {
+                member.separators.push_back(pos);
+            }
+            [[fallthrough]];
+        case '}':
+        case ']':
+            if (depth == 2 && c == ']' && nested_container == '[') {
+                member.separators.push_back(pos);
+            }
+            if (depth == 1 && c != ']') {
+                if (member.key) {
+                    if (!member.value_begin) {
+                        throw json::ParsingError("parallel load failed: invalid JSON");
+                    }
+                    member.value_end = pos;
+                    members.push_back(std::move(member));
+                }
+                member = RootMember{};
+                if (c == '}') {
+                    return members;
+                }
+            }
+            if (c != ',') {
+                --depth;
+            }
+            break;
+        default:
+            if (depth == 0 && !isspace(static_cast<unsigned char>(c))) {
+                throw json::ParsingError("parallel load failed: root is not dict");
+            }
+            break;
+        }
+    }
+    throw json::ParsingError("parallel load failed: invalid JSON");
+}
+
+// Разбирает элементы массива, записанные через запятую (без квадратных скобок)
+Array LoadArrayElements(const char* begin, const char* end) {
+    MemoryBuffer buffer(begin, end);
+    istream input(&buffer);
+    Array result;
+    char c;
+    while (input >> c) {
+        if (c != ',') {
+            input.putback(c);
+        }
+        result.push_back(LoadNode(input));
+    }
+    return result;
+}
+
+Node LoadSpan(const char* begin, const char* end) {
+    MemoryBuffer buffer(begin, end);
+    istream input(&buffer);
+    return LoadNode(input);
+}
+
+// Находит первый символ, требующий экранирования; SSE2 проверяет по 16 символов за раз
+size_t FindEscapedChar(const char* data, size_t size) {
+    size_t pos = 0;
+#ifdef __SSE2__
+    const __m128i new_line = _mm_set1_epi8('\n');
+    const __m128i carriage_return = _mm_set1_epi8('\r');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    for (; pos + 16 <= size; pos += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        const __m128i matches = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, new_line), _mm_cmpeq_epi8(chunk, carriage_return)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, tab)),
+                         _mm_cmpeq_epi8(chunk, backslash)));
+        if (const auto mask = static_cast<unsigned>(_mm_movemask_epi8(matches))) {
+            return pos + static_cast<size_t>(std::countr_zero(mask));
+        }
+    }
+#endif
+    for (; pos < size; ++pos) {
+        const char ch = data[pos];
+        if (ch == '\n' || ch == '\r' || ch == '"' || ch == '\t' || ch == '\\') {
+            break;
+        }
+    }
+    return pos;
+}
+
 }  // namespace
 
+void PrintEscapedString(std::string_view value, std::ostream& output) {
+    // Участки без спецсимволов выводим целиком, спецсимволы - escape-последовательностями
+    while (!value.empty()) {
+        const size_t pos = FindEscapedChar(value.data(), value.size());
+        output.write(value.data(), static_cast<std::streamsize>(pos));
+        if (pos == value.size()) {
+            break;
+        }
+        switch (value[pos]) {
+        case '\n': output.write("\\n", 2); break;
+        case '\r': output.write("\\r", 2); break;
+        case '"': output.write("\\\"", 2); break;
+        case '\t': output.write("\\t", 2); break;
+        case '\\': output.write("\\\\", 2); break;
+        default: break;
+        }
+        value.remove_prefix(pos + 1);
+    }
+}
+
 void Node::Print(std::ostream &output) const {
-    std::visit(DataPrinter{output}, static_cast<NodeParentClass>(*this));
+    std::visit(DataPrinter{output}, GetValue());
 }
 
 int Node::AsInt() const {
@@ -276,8 +466,157 @@ Document Load(istream& input) {
     return Document{LoadNode(input)};
 }
 
+Document LoadStreaming(istream& input, std::string_view streamed_key,
+                       const std::function<void(Node)>& on_element) {
+    char c;
+    if (!(input >> c) || c != '{') {
+        throw json::ParsingError("streaming load failed: root is not dict");
+    }
+
+    Dict result;
+    for (; input >> c && c != '}';) {
+        if (c == ',') {
+            input >> c;
+        }
+
+        string key = LoadString(input).AsString();
+        if (!(input >> c) || c != ':') {
+            throw json::ParsingError("streaming load failed: invalid JSON");
+        }
+        if (key != streamed_key) {
+            result.insert({move(key), LoadNode(input)});
+            continue;
+        }
+
+        // Элементы потокового массива отдаём сразу после разбора
+        if (!(input >> c) || c != '[') {
+            throw json::ParsingError("streaming load failed: streamed value is not array");
+        }
+        for (; input >> c && c != ']';) {
+            if (c != ',') {
+                input.putback(c);
+            }
+            on_element(LoadNode(input));
+        }
+        if (c != ']') {
+            throw json::ParsingError("streaming load failed: invalid JSON");
+        }
+        result.insert({move(key), Node{Array{}}});
+    }
+    if (c != '}') {
+        throw json::ParsingError("streaming load failed: invalid JSON");
+    }
+
+    return Document{Node{move(result)}};
+}
+
+Document LoadParallel(istream& input, size_t thread_count) {
+    // Читаем документ целиком: границы элементов ищутся по тексту
+    std::string text;
+    std::array<char, 1 << 16> read_buffer;
+    while (input.read(read_buffer.data(), read_buffer.size()) || input.gcount() > 0) {
+        text.append(read_buffer.data(), static_cast<size_t>(input.gcount()));
+    }
+    const char* text_begin = text.data();
+    const char* text_end = text.data() + text.size();
+    auto members(ScanRootMembers(text_begin, text_end));
+
+    // Нарезаем элементы массивов на последовательные куски
+    struct Chunk {
+        size_t member_index;
+        const char* begin;
+        const char* end;
+    };
+    thread_count = std::max<size_t>(thread_count, 1);
+    std::vector<Chunk> chunks;
+    for (size_t i = 0; i < members.size(); ++i) {
+        const auto& separators = members[i].separators;
+        if (!members[i].is_array) {
+            continue;
+        }
+        const size_t element_count = separators.size() - 1;
+        const size_t chunk_size = std::max<size_t>(1, element_count / (thread_count * 8));
+        for (size_t first = 0; first < element_count; first += chunk_size) {
+            const size_t last = std::min(first + chunk_size, element_count);
+            chunks.push_back({i, separators[first] + 1, separators[last]});
+        }
+    }
+
+    // Разбираем куски пулом потоков, каждый поток берёт следующий свободный кусок
+    std::vector<Array> chunk_results(chunks.size());
+    std::vector<std::exception_ptr> chunk_errors(chunks.size());
+    std::atomic<size_t> next_chunk{0};
+    auto worker = [&]() {
+        for (size_t index = next_chunk++; index < chunks.size(); index = next_chunk++) {
+            try {
+                chunk_results[index] = LoadArrayElements(chunks[index].begin, chunks[index].end);
+            } catch (...) {
+                chunk_errors[index] = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(thread_count - 1);
+    for (size_t i = 1; i < std::min(thread_count, chunks.size()); ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    for (const auto& error : chunk_errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Склеиваем результаты в исходном порядке
+    std::vector<Array> member_arrays(members.size());
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        auto& array = member_arrays[chunks[i].member_index];
+        if (array.empty()) {
+            array = std::move(chunk_results[i]);
+        } else {
+            array.insert(array.end(),
+                         std::make_move_iterator(chunk_results[i].begin()),
+                         std::make_move_iterator(chunk_results[i].end()));
+        }
+    }
+
+    Dict root;
+    for (size_t i = 0; i < members.size(); ++i) {
+        string key = LoadSpan(members[i].key - 1, text_end).AsString();
+        Node value = members[i].is_array
+                   ? Node{std::move(member_arrays[i])}
+                   : LoadSpan(members[i].value_begin, members[i].value_end);
+        root.insert({move(key), move(value)});
+    }
+    return Document{Node{std::move(root)}};
+}
+
 void Print(const Document& doc, std::ostream& output) {
     doc.GetRoot().Print(output);
 }
 
+size_t GetHeapBytes(const Node& node) {
+    if (node.IsString()) {
+        return memory::GetHeapBytes(node.AsString());
+    }
+    if (node.IsArray()) {
+        size_t bytes = memory::GetHeapBytes(node.AsArray());
+        for (const auto& element : node.AsArray()) {
+            bytes += GetHeapBytes(element);
+        }
+        return bytes;
+    }
+    if (node.IsDict()) {
+        size_t bytes = memory::GetTreeBytes(node.AsDict());
+        for (const auto& [key, value] : node.AsDict()) {
+            bytes += memory::GetHeapBytes(key) + GetHeapBytes(value);
+        }
+        return bytes;
+    }
+    return 0;
+}
+
 }  // namespace json
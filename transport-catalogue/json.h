@@ -1,8 +1,10 @@
 #pragma once
 
+#include <functional>
 #include <iostream>
 #include <map>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -11,6 +13,10 @@ using namespace std::literals;
 namespace json {
 
 class Node;
+
+// Выводит содержимое строки JSON (без кавычек), экранируя переводы строк, табуляцию, кавычки и обратную косую черту
+void PrintEscapedString(std::string_view value, std::ostream& output);
+
 // Сохраните объявления Dict и Array без изменения
 using Dict = std::map<std::string, Node>;
 using Array = std::vector<Node>;
@@ -58,27 +64,13 @@ private:
         inline void operator()(std::nullptr_t) const { out << "null"sv; }
         inline void operator()(int value) const { out << value; }
         inline void operator()(double value) const { out << value; }
-        inline void operator()(std::string value) const {
+        inline void operator()(const std::string& value) const {
             out << "\"";
-            for (auto ch : value) {
-                if (ch == '\n' || ch == '\r' || ch == '"' || ch == '\t' || ch == '\\') {
-                    out << '\\';
-                    switch (ch) {
-                    case '\n': out << 'n'; break;
-                    case '\r': out << 'r'; break;
-                    case '"': out << '"'; break;
-                    case '\t': out << 't'; break;
-                    case '\\': out << '\\'; break;
-                    default: break;
-                    }
-                } else {
-                    out << ch;
-                }
-            }
+            PrintEscapedString(value, out);
             out << "\"";
         }
         inline void operator()(bool value) const { out << std::boolalpha << value << std::noboolalpha; }
-        inline void operator()(Array value) const {
+        inline void operator()(const Array& value) const {
             out << '[';
             for (auto it = value.cbegin(); it != value.cend(); ++it) {
                 if (it != value.cbegin()) out << ',';
@@ -86,7 +78,7 @@ private:
             }
             out << ']';
         }
-        inline void operator()(Dict value) const {
+        inline void operator()(const Dict& value) const {
             out << '{';
             for (auto it = value.cbegin(); it != value.cend(); ++it) {
                 if (it != value.cbegin()) out << ',';
@@ -120,6 +112,18 @@ private:
 
 Document Load(std::istream& input);
 
+// Загружает документ с корневым словарём, разбирая элементы его массивов
+// (base_requests, stat_requests) параллельно в thread_count потоках
+Document LoadParallel(std::istream& input, size_t thread_count);
+
+// Загружает документ с корневым словарём, отдавая элементы массива streamed_key в on_element
+// по мере разбора (в документе под этим ключом остаётся пустой массив)
+Document LoadStreaming(std::istream& input, std::string_view streamed_key,
+                       const std::function<void(Node)>& on_element);
+
 void Print(const Document& doc, std::ostream& output);
 
+// Память в куче, занимаемая узлом и всеми вложенными узлами (оценка)
+size_t GetHeapBytes(const Node& node);
+
 }  // namespace json
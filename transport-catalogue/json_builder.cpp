@@ -7,14 +7,16 @@ Builder::Builder() {
 }
 
 Builder::DictContext Builder::StartDict() {
-    // Если строка последн. элемент (значит перед нами были StartDict, Key) или если у нас массив
-    if (GetLastNode()->IsString() || GetLastNode()->IsArray()) {
-        auto dict_node = new Node(Dict{});
-        nodes_stack_.push_back(dict_node);
+    if (IsDictValuePending()) {
+        // Если перед нами были StartDict, Key: словарь становится значением по ключу
+        GetLastNode()->GetValue() = Dict{};
+    } else if (GetLastNode()->IsArray()) {
+        // Если у нас массив: словарь создаётся сразу в нём (указатель стабилен, пока словарь не закончен)
+        auto& array = std::get<Array>(GetLastNode()->GetValue());
+        nodes_stack_.push_back(&array.emplace_back(Dict{}));
     } else if (nodes_stack_.size() == 1) { 
         // Если размер стэка всего один: устанавливаем значение (дальше Key, EndDict)
-        Node::Value& last_node_value = GetLastNode()->GetValue();
-        last_node_value = std::move(Dict{});
+        GetLastNode()->GetValue() = Dict{};
     } else {
         throw std::logic_error("Builder.StartDict: Failed: try to start dict to the wrong place");
     }
@@ -23,30 +25,21 @@ Builder::DictContext Builder::StartDict() {
 }
 
 Builder::MainContext Builder::EndDict() {
-    if (GetLastNode()->IsDict()) {
-        if (nodes_stack_.size() == 1) {
-            nodes_stack_.pop_back();
-        } else {
-            // Получаем наш законченный словарь
-            auto dict_node = GetLastNode();
-            nodes_stack_.pop_back();
-
-            // Завершаем в словаре ключ-значение или добавляем в массив элемент
-            Value(dict_node->GetValue());
-            delete dict_node;
-        }
-    } else {
+    if (!GetLastNode()->IsDict()) {
         throw std::logic_error("Builder.EndDict: Failed: last node is not dict");
     }
+    // Словарь уже лежит в родителе: остаётся только снять его со стэка
+    nodes_stack_.pop_back();
 
     return Builder::MainContext{*this};
 }
 
 Builder::DictKeyValueContext Builder::Key(std::string dict_key) {
-    // Если последн. элемент словарь: добавляем ключ словаря как последн. элемент (дальше Value, StartArray, StartDict)
+    // Если последн. элемент словарь: заводим в нём значение по ключу (дальше Value, StartArray, StartDict)
     if (GetLastNode()->IsDict()) {
-        auto key_node = new Node{std::move(dict_key)};
-        nodes_stack_.emplace_back(key_node);
+        auto& value_node = std::get<Dict>(GetLastNode()->GetValue())[std::move(dict_key)];
+        value_node = Node{};
+        nodes_stack_.push_back(&value_node);
     } else {
         throw std::logic_error("Builder.Key: Failed: last node is not dict");
     }
@@ -55,54 +48,41 @@ Builder::DictKeyValueContext Builder::Key(std::string dict_key) {
 }
 
 Builder::ArrayContext Builder::StartArray() {
-    // Если строка последн. элемент (значит перед нами были StartDict, Key) или если у нас массив
-    if (GetLastNode()->IsString() || GetLastNode()->IsArray()) {
-        auto dict_node = new Node(Array{});
-        nodes_stack_.push_back(dict_node);
+    if (IsDictValuePending()) {
+        // Если перед нами были StartDict, Key: массив становится значением по ключу
+        GetLastNode()->GetValue() = Array{};
+    } else if (GetLastNode()->IsArray()) {
+        // Если у нас массив: вложенный массив создаётся сразу в нём
+        auto& array = std::get<Array>(GetLastNode()->GetValue());
+        nodes_stack_.push_back(&array.emplace_back(Array{}));
     } else if (nodes_stack_.size() == 1) { 
         // Если размер стэка всего один: устанавливаем значение (дальше Value, StartDict, EndArray)
-        GetLastNode()->GetValue().emplace<Array>(Array{});
+        GetLastNode()->GetValue() = Array{};
     } else {
-        throw std::logic_error("Builder.StartArray: Failed: try to start dict to the wrong place");
+        throw std::logic_error("Builder.StartArray: Failed: try to start array to the wrong place");
     }
     
     return Builder::ArrayContext{*this};
 }
 
 Builder::MainContext Builder::EndArray() {
-    if (GetLastNode()->IsArray()) {
-        if (nodes_stack_.size() == 1) {
-            nodes_stack_.pop_back();
-        } else {
-            // Получаем наш массив
-            auto array_node = GetLastNode();
-            nodes_stack_.pop_back();
-
-            // Завершаем в словаре ключ-значение или добавляем в след. массив элемент
-            Value(array_node->GetValue());
-            delete array_node;
-        }
-    } else {
-        throw std::logic_error("Builder.EndDict: Failed: last node is not dict");
+    if (!GetLastNode()->IsArray()) {
+        throw std::logic_error("Builder.EndArray: Failed: last node is not array");
     }
+    // Массив уже лежит в родителе: остаётся только снять его со стэка
+    nodes_stack_.pop_back();
+
     return Builder::MainContext{*this};
 }
 
 Builder::MainContext Builder::Value(Node::Value value) {
-    // Если строка последн. элемент: значит перед нами были StartDict, Key
-    if (GetLastNode()->IsString()) {
-        // Забираем ключ
-        auto key = std::move((std::get<std::string>(GetLastNode()->GetValue())));
-        delete GetLastNode();
+    if (IsDictValuePending()) {
+        // Если перед нами были StartDict, Key: устанавливаем в словаре значение (дальше Key, EndDict)
+        GetLastNode()->GetValue() = std::move(value);
         nodes_stack_.pop_back();
-
-        // Устанавливаем в словаре значение (дальше Key, EndDict)
-        (std::get<Dict>(GetLastNode()->GetValue()))[key] = Node{std::move(value)};
     } else if (GetLastNode()->IsArray()) {
         // Если массив последн. элемент
-        Node value_node;
-        value_node.GetValue() = std::move(value);
-        (std::get<Array>(GetLastNode()->GetValue())).push_back(value_node);
+        std::get<Array>(GetLastNode()->GetValue()).emplace_back(std::move(value));
     } else if (nodes_stack_.size() == 1) {
         // Если размер стэка всего один: устанавливаем значение (конец: JSON закончен)
         GetLastNode()->GetValue() = std::move(value);
@@ -128,4 +108,9 @@ Node* Builder::GetLastNode() {
     return nodes_stack_.back();
 }
 
-}  // namespace json
\ No newline at end of file
+bool Builder::IsDictValuePending() {
+    // Корень тоже пуст до первого значения, но он не является значением словаря
+    return nodes_stack_.size() > 1 && GetLastNode()->IsNull();
+}
+
+}  // namespace json
@@ -2,6 +2,8 @@
 
 #include "json.h"
 
+#include <vector>
+
 using namespace std::literals;
 
 namespace json {
@@ -94,8 +96,12 @@ public:
 private:
     Node* GetLastNode();
 
+    // Последний элемент стэка - значение по ключу словаря, которое ещё не задано
+    bool IsDictValuePending();
+
 private:
     Node root_;
+    // Вложенные контейнеры строятся прямо в родителе, стэк хранит указатели на них
     std::vector<Node*> nodes_stack_;
 };
 
@@ -0,0 +1,236 @@
+#include "json_msgpack.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <utility>
+#include <variant>
+
+namespace json {
+
+namespace {
+
+// ---------- Запись ------------------
+
+class MsgPackWriter {
+public:
+    explicit MsgPackWriter(std::ostream& out)
+        : out_(out)
+    {}
+
+    void operator()(std::nullptr_t) const { PutByte(0xc0); }
+    void operator()(bool value) const { PutByte(value ? 0xc3 : 0xc2); }
+    void operator()(int value) const {
+        if (value >= 0 && value <= 0x7f) {
+            PutByte(static_cast<uint8_t>(value));
+        } else if (value < 0 && value >= -32) {
+            PutByte(static_cast<uint8_t>(value));
+        } else if (value >= std::numeric_limits<int16_t>::min() && value <= std::numeric_limits<int16_t>::max()) {
+            PutByte(0xd1);
+            PutBigEndian(static_cast<uint16_t>(value), 2);
+        } else {
+            PutByte(0xd2);
+            PutBigEndian(static_cast<uint32_t>(value), 4);
+        }
+    }
+    void operator()(double value) const {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        PutByte(0xcb);
+        PutBigEndian(bits, 8);
+    }
+    void operator()(const std::string& value) const {
+        PutHeader(value.size(), 0xa0, 31, 0xd9, 0xda, 0xdb);
+        out_.write(value.data(), static_cast<std::streamsize>(value.size()));
+    }
+    void operator()(const Array& value) const {
+        PutHeader(value.size(), 0x90, 15, 0, 0xdc, 0xdd);
+        for (const auto& node : value) {
+            std::visit(*this, node.GetValue());
+        }
+    }
+    void operator()(const Dict& value) const {
+        PutHeader(value.size(), 0x80, 15, 0, 0xde, 0xdf);
+        for (const auto& [key, node] : value) {
+            (*this)(key);
+            std::visit(*this, node.GetValue());
+        }
+    }
+
+private:
+    void PutByte(uint8_t byte) const {
+        out_.put(static_cast<char>(byte));
+    }
+
+    void PutBigEndian(uint64_t value, int byte_count) const {
+        char bytes[8];
+        for (int i = byte_count - 1; i >= 0; --i) {
+            bytes[i] = static_cast<char>(value & 0xff);
+            value >>= 8;
+        }
+        out_.write(bytes, byte_count);
+    }
+
+    // Заголовок контейнера: fix-формат, затем 8/16/32-битная длина (код 0 - формат отсутствует)
+    void PutHeader(size_t size, uint8_t fix_code, size_t fix_max, uint8_t code8, uint8_t code16, uint8_t code32) const {
+        if (size <= fix_max) {
+            PutByte(static_cast<uint8_t>(fix_code | size));
+        } else if (code8 && size <= 0xff) {
+            PutByte(code8);
+            PutBigEndian(size, 1);
+        } else if (size <= 0xffff) {
+            PutByte(code16);
+            PutBigEndian(size, 2);
+        } else {
+            PutByte(code32);
+            PutBigEndian(size, 4);
+        }
+    }
+
+    std::ostream& out_;
+};
+
+// ---------- Чтение ------------------
+
+class MsgPackReader {
+public:
+    explicit MsgPackReader(std::istream& input)
+        : input_(input)
+    {}
+
+    Node LoadNode() {
+        const uint8_t code = GetByte();
+        if (code <= 0x7f) {
+            return Node{static_cast<int>(code)};
+        }
+        if (code >= 0xe0) {
+            return Node{static_cast<int>(static_cast<int8_t>(code))};
+        }
+        if ((code & 0xe0) == 0xa0) {
+            return LoadString(code & 0x1f);
+        }
+        if ((code & 0xf0) == 0x90) {
+            return LoadArray(code & 0x0f);
+        }
+        if ((code & 0xf0) == 0x80) {
+            return LoadDict(code & 0x0f);
+        }
+
+        switch (code) {
+        case 0xc0: return Node{};
+        case 0xc2: return Node{false};
+        case 0xc3: return Node{true};
+        case 0xca: {
+            const auto bits = static_cast<uint32_t>(GetBigEndian(4));
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return Node{static_cast<double>(value)};
+        }
+        case 0xcb: {
+            const uint64_t bits = GetBigEndian(8);
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return Node{value};
+        }
+        case 0xcc: return ToIntNode(GetBigEndian(1));
+        case 0xcd: return ToIntNode(GetBigEndian(2));
+        case 0xce: return ToIntNode(GetBigEndian(4));
+        case 0xcf: return ToIntNode(GetBigEndian(8));
+        case 0xd0: return ToIntNode(static_cast<int8_t>(GetBigEndian(1)));
+        case 0xd1: return ToIntNode(static_cast<int16_t>(GetBigEndian(2)));
+        case 0xd2: return ToIntNode(static_cast<int32_t>(GetBigEndian(4)));
+        case 0xd3: return ToIntNode(static_cast<int64_t>(GetBigEndian(8)));
+        case 0xd9: return LoadString(GetBigEndian(1));
+        case 0xda: return LoadString(GetBigEndian(2));
+        case 0xdb: return LoadString(GetBigEndian(4));
+        case 0xdc: return LoadArray(GetBigEndian(2));
+        case 0xdd: return LoadArray(GetBigEndian(4));
+        case 0xde: return LoadDict(GetBigEndian(2));
+        case 0xdf: return LoadDict(GetBigEndian(4));
+        default:
+            throw ParsingError("load msgpack failed: unsupported type");
+        }
+    }
+
+private:
+    uint8_t GetByte() {
+        const auto byte = input_.get();
+        if (byte == std::istream::traits_type::eof()) {
+            throw ParsingError("load msgpack failed: unexpected end of data");
+        }
+        return static_cast<uint8_t>(byte);
+    }
+
+    uint64_t GetBigEndian(int byte_count) {
+        uint64_t value = 0;
+        for (int i = 0; i < byte_count; ++i) {
+            value = (value << 8) | GetByte();
+        }
+        return value;
+    }
+
+    template <typename Integer>
+    static Node ToIntNode(Integer value) {
+        if (std::cmp_less(value, std::numeric_limits<int>::min())
+            || std::cmp_greater(value, std::numeric_limits<int>::max())) {
+            throw ParsingError("load msgpack failed: integer out of range");
+        }
+        return Node{static_cast<int>(value)};
+    }
+
+    Node LoadString(uint64_t size) {
+        // Строка читается кусками не больше MAX_RESERVE байт: память растёт по мере прихода данных,
+        // а не по размеру из заголовка
+        std::string value;
+        while (value.size() < size) {
+            const size_t offset = value.size();
+            const size_t chunk = static_cast<size_t>(std::min<uint64_t>(size - offset, MAX_RESERVE));
+            value.resize(offset + chunk);
+            if (!input_.read(value.data() + offset, static_cast<std::streamsize>(chunk))) {
+                throw ParsingError("load msgpack failed: unexpected end of data");
+            }
+        }
+        return Node{std::move(value)};
+    }
+
+    Node LoadArray(uint64_t size) {
+        Array result;
+        result.reserve(std::min<uint64_t>(size, MAX_RESERVE));
+        for (uint64_t i = 0; i < size; ++i) {
+            result.push_back(LoadNode());
+        }
+        return Node{std::move(result)};
+    }
+
+    Node LoadDict(uint64_t size) {
+        Dict result;
+        for (uint64_t i = 0; i < size; ++i) {
+            Node key = LoadNode();
+            if (!key.IsString()) {
+                throw ParsingError("load msgpack failed: map key is not string");
+            }
+            result.insert({std::move(std::get<std::string>(key.GetValue())), LoadNode()});
+        }
+        return Node{std::move(result)};
+    }
+
+    // Размер из заголовка не доверяем целиком: резервируем не больше этого числа элементов
+    // (и байт строки за раз)
+    static constexpr uint64_t MAX_RESERVE = 1 << 16;
+
+    std::istream& input_;
+};
+
+}  // namespace
+
+Document LoadMsgPack(std::istream& input) {
+    return Document{MsgPackReader(input).LoadNode()};
+}
+
+void PrintMsgPack(const Document& doc, std::ostream& output) {
+    std::visit(MsgPackWriter(output), doc.GetRoot().GetValue());
+}
+
+}  // namespace json
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "json.h"
+
+#include <iostream>
+
+/*
+ * Двоичное представление json::Document в формате MessagePack (https://msgpack.org).
+ * Узлы отображаются один к одному: null -> nil, bool -> bool, int -> int,
+ * double -> float 64, string -> str, Array -> array, Dict -> map со строковыми ключами.
+ */
+
+namespace json {
+
+// Считывает документ в формате MessagePack, при ошибках выбрасывает ParsingError
+Document LoadMsgPack(std::istream& input);
+
+// Выводит документ в формате MessagePack
+void PrintMsgPack(const Document& doc, std::ostream& output);
+
+}  // namespace json
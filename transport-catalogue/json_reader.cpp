@@ -1,164 +1,616 @@
 #include "graph.h"
+#include "instrumentation.h"
 #include "json_builder.h"
 #include "json_reader.h"
+#include "json_schema.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <optional>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 using namespace std::literals;
 
 namespace transport {
 
-void FillTransportCatalogue(TransportCatalogue& db, const json::Document& doc) {
-    auto base_requests(doc.GetRoot().AsDict().at("base_requests").AsArray());
+namespace {
 
-    //Создаем остановки 
-    for (const auto& request : base_requests) {
-        auto request_map(request.AsDict());
-        if (request_map.at("type").AsString() != "Stop"s) {
-            continue;
+using namespace json::schema;
+
+// Таблица значений поля "type", порядок совпадает с RequestType
+constexpr KeyTable<7> request_types({"Stop"sv, "Bus"sv, "Route"sv, "Map"sv, "Stats"sv, "MapTile"sv, "MapImage"sv});
+
+RequestType ToRequestType(const json::Node& node) {
+    return static_cast<RequestType>(request_types.Find(node.AsString()));
+}
+
+// Запрос base_requests до того, как станет известен его тип
+struct BaseRequestRecord {
+    RequestType type = RequestType::UNKNOWN;
+    StopRequest stop;
+    BusRequest bus;
+};
+
+constexpr Binding<BaseRequestRecord, 7> base_request_binding({{
+    {"type"sv, [](BaseRequestRecord& r, const json::Node& n) { r.type = ToRequestType(n); }},
+    {"name"sv, [](BaseRequestRecord& r, const json::Node& n) { r.stop.name = r.bus.name = n.AsString(); }},
+    {"latitude"sv, [](BaseRequestRecord& r, const json::Node& n) { r.stop.coordinates.lat = n.AsDouble(); }},
+    {"longitude"sv, [](BaseRequestRecord& r, const json::Node& n) { r.stop.coordinates.lng = n.AsDouble(); }},
+    {"road_distances"sv, [](BaseRequestRecord& r, const json::Node& n) {
+        r.stop.road_distances.reserve(n.AsDict().size());
+        for (const auto& [stop_id, distance] : n.AsDict()) {
+            r.stop.road_distances.emplace_back(stop_id, distance.AsInt());
         }
-        db.AddStop(request_map.at("name").AsString(),
-                   {
-                       request_map.at("latitude").AsDouble(),
-                       request_map.at("longitude").AsDouble()
-                   });
-    }
+    }},
+    {"stops"sv, [](BaseRequestRecord& r, const json::Node& n) {
+        r.bus.stops.reserve(n.AsArray().size());
+        for (const auto& stop_id : n.AsArray()) {
+            r.bus.stops.emplace_back(stop_id.AsString());
+        }
+    }},
+    {"is_roundtrip"sv, [](BaseRequestRecord& r, const json::Node& n) { r.bus.is_roundtrip = n.AsBool(); }},
+}});
 
-    //Определяем расстояния между остановками
-    for (const auto& base_request : base_requests) {
-        auto request_map(base_request.AsDict());
-        if (request_map.at("type").AsString() != "Stop"s) {
-            continue;
+constexpr Binding<StatRequest, 8> stat_request_binding({{
+    {"id"sv, [](StatRequest& r, const json::Node& n) { r.id = n.AsInt(); }},
+    {"type"sv, [](StatRequest& r, const json::Node& n) { r.type = ToRequestType(n); }},
+    {"name"sv, [](StatRequest& r, const json::Node& n) { r.name = n.AsString(); }},
+    {"from"sv, [](StatRequest& r, const json::Node& n) { r.from = n.AsString(); }},
+    {"to"sv, [](StatRequest& r, const json::Node& n) { r.to = n.AsString(); }},
+    {"zoom"sv, [](StatRequest& r, const json::Node& n) { r.zoom = n.AsInt(); }},
+    {"x"sv, [](StatRequest& r, const json::Node& n) { r.x = n.AsInt(); }},
+    {"y"sv, [](StatRequest& r, const json::Node& n) { r.y = n.AsInt(); }},
+}});
+
+#if TC_INSTRUMENTATION
+// Гистограммы задержек по типам запросов (ищутся по имени один раз)
+instrumentation::LatencyHistogram& GetRequestLatency(RequestType type) {
+    static const std::array<instrumentation::LatencyHistogram*, 8> histograms{
+        &instrumentation::Registry::Instance().Request("Stop"sv),
+        &instrumentation::Registry::Instance().Request("Bus"sv),
+        &instrumentation::Registry::Instance().Request("Route"sv),
+        &instrumentation::Registry::Instance().Request("Map"sv),
+        &instrumentation::Registry::Instance().Request("Stats"sv),
+        &instrumentation::Registry::Instance().Request("MapTile"sv),
+        &instrumentation::Registry::Instance().Request("MapImage"sv),
+        &instrumentation::Registry::Instance().Request("Unknown"sv)};
+    return *histograms[static_cast<size_t>(type)];
+}
+
+// Имена событий трассировки запросов (строки со статическим временем жизни)
+std::string_view GetRequestTraceName(RequestType type) {
+    static constexpr std::array<std::string_view, 8> names{"Stop"sv, "Bus"sv, "Route"sv, "Map"sv, "Stats"sv, "MapTile"sv,
+                                                           "MapImage"sv, "Unknown"sv};
+    return names[static_cast<size_t>(type)];
+}
+#endif
+
+// Двоичные данные (изображение карты) в строке JSON
+std::string EncodeBase64(std::string_view data) {
+    static constexpr std::string_view alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"sv;
+    std::string encoded;
+    encoded.reserve((data.size() + 2) / 3 * 4);
+    for (size_t i = 0; i < data.size(); i += 3) {
+        const size_t count = std::min<size_t>(3, data.size() - i);
+        uint32_t group = 0;
+        for (size_t j = 0; j < 3; ++j) {
+            group = (group << 8) | (j < count ? static_cast<uint8_t>(data[i + j]) : 0);
         }
-        
-        auto road_distances(request_map.at("road_distances").AsDict());
-        for (const auto& [stop_id, distance] : road_distances) {
-            db.SetStopDistance(db.GetStop(request_map.at("name").AsString()),
-                               db.GetStop(stop_id),
-                               distance.AsInt());
+        for (size_t j = 0; j < 4; ++j) {
+            encoded.push_back(j <= count ? alphabet[(group >> (18 - 6 * j)) & 0x3F] : '=');
         }
     }
+    return encoded;
+}
 
-    //Создаем маршруты
-    for (const auto& base_request : base_requests) {
-        auto request_map(base_request.AsDict());
-        if (request_map.at("type").AsString() != "Bus"s) {
-            continue;
+}  // namespace
+
+BaseRequestsIngestor::BaseRequestsIngestor(TransportCatalogue& db)
+    : db_(db)
+{}
+
+void BaseRequestsIngestor::Add(const json::Node& base_request) {
+    BaseRequestRecord record;
+    const auto seen = base_request_binding.Decode(base_request.AsDict(), record);
+    // Обязательные ключи те же, что требовались при разборе через Dict::at
+    base_request_binding.Require(seen, {"type"sv});
+    switch (record.type) {
+    case RequestType::STOP:
+        base_request_binding.Require(seen, {"name"sv, "latitude"sv, "longitude"sv});
+        //Создаем остановку сразу: маршрутам и расстояниям она понадобится в Finish
+        db_.AddStop(std::string(record.stop.name), record.stop.coordinates);
+        stop_requests_.push_back(std::move(record.stop));
+        break;
+    case RequestType::BUS:
+        base_request_binding.Require(seen, {"name"sv, "stops"sv, "is_roundtrip"sv});
+        bus_requests_.push_back(std::move(record.bus));
+        break;
+    default:
+        break;
+    }
+}
+
+void BaseRequestsIngestor::Finish() {
+    TC_PHASE_SCOPE("ingest_finish"sv);
+
+    SetStopDistances();
+    AddBuses();
+
+    stop_requests_.clear();
+    bus_requests_.clear();
+}
+
+//Определяем расстояния между остановками
+void BaseRequestsIngestor::SetStopDistances() {
+    TC_TRACE_SCOPE("ingest_distances"sv);
+    for (const auto& request : stop_requests_) {
+        auto stop_from(db_.GetStop(request.name));
+        for (const auto& [stop_id, distance] : request.road_distances) {
+            db_.SetStopDistance(stop_from, db_.GetStop(stop_id), distance);
         }
+    }
+}
 
+//Создаем маршруты
+void BaseRequestsIngestor::AddBuses() {
+    TC_TRACE_SCOPE("ingest_buses"sv);
+    for (const auto& request : bus_requests_) {
         //Получаем остановки
-        auto stops(request_map.at("stops").AsArray());
-        std::vector<StopPtr> route;
-        route.reserve(stops.size());
-        for (const auto& stop_id : stops) {
-            auto stop(db.GetStop(stop_id.AsString()));
-            route.push_back(stop);
+        std::vector<StopPtr> route_stops;
+        route_stops.reserve(request.is_roundtrip ? request.stops.size() : request.stops.size() * 2);
+        for (auto stop_id : request.stops) {
+            route_stops.push_back(db_.GetStop(stop_id));
         }
 
         //Получаем маршрут из остановок
-        std::vector<StopPtr> route_stops(route.begin(), route.end());
-        bool is_roundtrip(request_map.at("is_roundtrip").AsBool());
-        if (!is_roundtrip) {
-            route_stops.insert(route_stops.end(), std::next(route.rbegin()), route.rend());
+        if (!request.is_roundtrip && !route_stops.empty()) {
+            route_stops.insert(route_stops.end(), std::next(route_stops.rbegin()), route_stops.rend());
         }       
 
         //Создаем маршрут  
-        db.AddBus(request_map.at("name").AsString(), 
-                  std::move(route_stops),
-                  is_roundtrip);
+        db_.AddBus(std::string(request.name), 
+                   std::move(route_stops),
+                   request.is_roundtrip);
     }
+}
 
-    // Устанавливаем общие настройки маршрутов
+void FillRoutingSettings(TransportCatalogue& db, const json::Document& doc) {
+    TC_TRACE_SCOPE("fill_routing_settings"sv);
     static constexpr double km_to_m_modifier = 1000.0 / 60.0;
-    auto routing_settings(doc.GetRoot().AsDict().at("routing_settings").AsDict());
+    const auto& routing_settings(doc.GetRoot().AsDict().at("routing_settings").AsDict());
     db.SetRoutingSettings(RoutingSettings{routing_settings.at("bus_wait_time").AsInt(),
                                           routing_settings.at("bus_velocity").AsDouble() * km_to_m_modifier});
 }
 
-json::Document ExecuteStatRequests(const RequestHandler& request_handler, const json::Document& doc) {
-    auto stat_requests(doc.GetRoot().AsDict().at("stat_requests").AsArray());
+void FillTransportCatalogue(TransportCatalogue& db, const json::Document& doc) {
+    TC_PHASE_SCOPE("fill_transport_catalogue"sv);
+    BaseRequestsIngestor ingestor(db);
+    {
+        TC_TRACE_SCOPE("ingest_decode"sv);
+        for (const auto& base_request : doc.GetRoot().AsDict().at("base_requests").AsArray()) {
+            ingestor.Add(base_request);
+        }
+    }
+    ingestor.Finish();
 
-    // Обрабатываем запросы
-    json::Builder request_results;
-    request_results.StartArray();
-    for (const auto& request : stat_requests) {
-        auto request_map(request.AsDict());
-
-        // Результат запроса
-        json::Builder request_result;
-        request_result.StartDict()
-                      .Key("request_id").Value(request_map.at("id").AsInt());
-
-        // Обрабатываем запрос взависимости от типа запроса
-        if (request_map.at("type").AsString() == "Bus"s) {
-            auto bus_stat(request_handler.GetBusStat(request_map.at("name").AsString()));
-            if (bus_stat) {
-                request_result.Key("curvature").Value((*bus_stat).curvature)
-                              .Key("route_length").Value((*bus_stat).route_length)
-                              .Key("stop_count").Value((*bus_stat).stop_count)
-                              .Key("unique_stop_count").Value((*bus_stat).unique_stop_count);
-            } else {
-                request_result.Key("error_message").Value("not found"s);
+    // Устанавливаем общие настройки маршрутов
+    FillRoutingSettings(db, doc);
+}
+
+StatRequest ParseStatRequest(const json::Node& request) {
+    StatRequest result;
+    const auto seen = stat_request_binding.Decode(request.AsDict(), result);
+    stat_request_binding.Require(seen, {"id"sv, "type"sv});
+    switch (result.type) {
+    case RequestType::STOP:
+    case RequestType::BUS:
+        stat_request_binding.Require(seen, {"name"sv});
+        break;
+    case RequestType::ROUTE:
+        stat_request_binding.Require(seen, {"from"sv, "to"sv});
+        break;
+    case RequestType::MAP_TILE:
+        stat_request_binding.Require(seen, {"zoom"sv, "x"sv, "y"sv});
+        break;
+    default:
+        break;
+    }
+    return result;
+}
+
+json::Node ExecuteStatRequest(const RequestHandler& request_handler, const StatRequest& request) {
+    TC_TIMED_SCOPE(GetRequestLatency(request.type));
+    TC_TRACE_SCOPE_ARG(GetRequestTraceName(request.type), request.id);
+
+    // Результат запроса: вложенные массивы и словари строятся тем же строителем на месте
+    json::Builder request_result;
+    request_result.StartDict()
+                  .Key("request_id").Value(request.id);
+
+    // Обрабатываем запрос взависимости от типа запроса
+    switch (request.type) {
+    case RequestType::BUS: {
+        auto bus_stat(request_handler.GetBusStat(request.name));
+        if (bus_stat) {
+            request_result.Key("curvature").Value((*bus_stat).curvature)
+                          .Key("route_length").Value((*bus_stat).route_length)
+                          .Key("stop_count").Value((*bus_stat).stop_count)
+                          .Key("unique_stop_count").Value((*bus_stat).unique_stop_count);
+        } else {
+            request_result.Key("error_message").Value("not found"s);
+        }
+        break;
+    }
+    case RequestType::STOP: {
+        auto stop_stat(request_handler.GetStopStat(request.name));
+        if (stop_stat) {
+            request_result.Key("buses").StartArray();
+            for (auto& bus_name : (*stop_stat).bus_names) {
+                request_result.Value(bus_name);
             }
-        } else if (request_map.at("type").AsString() == "Stop"s) {
-            auto stop_stat(request_handler.GetStopStat(request_map.at("name").AsString()));
-            if (stop_stat) {
-                json::Builder bus_names;
-                bus_names.StartArray();
-                for (auto& bus_name : (*stop_stat).bus_names) {
-                    bus_names.Value(bus_name);
+            request_result.EndArray();
+        } else {
+            request_result.Key("error_message").Value("not found"s);
+        }
+        break;
+    }
+    case RequestType::MAP: {
+        request_result.Key("map").Value(request_handler.GetRenderedMap()->svg);
+        break;
+    }
+    case RequestType::ROUTE: {
+        auto route_stat = request_handler.FindRoute(request.from, request.to);
+        if (route_stat) {
+            request_result
+                .Key("total_time").Value((*route_stat).total_time)
+                .Key("items").StartArray();
+            for (const auto& item : (*route_stat).items) {
+                request_result.StartDict();
+                if (holds_alternative<RouteInfo::WaitingOnStopItem>(item)) {
+                    const auto& waiting_on_stop_item = get<RouteInfo::WaitingOnStopItem>(item);
+                    request_result
+                        .Key("type").Value("Wait"s)
+                        .Key("stop_name").Value(waiting_on_stop_item.stop->id)
+                        .Key("time").Value(waiting_on_stop_item.time);
+                } else {
+                    const auto& bus_item = get<RouteInfo::BusItem>(item);
+                    request_result
+                        .Key("type").Value("Bus"s)
+                        .Key("bus").Value(bus_item.bus->id)
+                        .Key("time").Value(bus_item.time)
+                        .Key("span_count").Value(static_cast<int>(bus_item.span_count));
                 }
-                request_result.Key("buses").Value(bus_names.EndArray()
-                                                           .Build().GetValue());
-            } else {
-                request_result.Key("error_message").Value("not found"s);
+                request_result.EndDict();
+            }
+            request_result.EndArray();
+        } else {
+            request_result.Key("error_message").Value("not found"s);
+        }
+        break;
+    }
+    case RequestType::STATS: {
+        const auto memory_usage = request_handler.GetMemoryUsage();
+        request_result.Key("memory_kib").StartDict();
+        for (const auto& [name, bytes] : memory_usage.GetEntries()) {
+            request_result.Key(name).Value(memory::ToKibibytes(bytes));
+        }
+        request_result.Key("total").Value(memory::ToKibibytes(memory_usage.GetTotal()))
+                      .EndDict()
+                      .Key("routing_mode").Value(std::string(request_handler.GetRoutingMode()));
+        break;
+    }
+    case RequestType::MAP_TILE: {
+        auto tile = request_handler.RenderTile(request.zoom, request.x, request.y);
+        if (tile) {
+            std::string svg;
+            request_handler.RenderSvg(*tile, svg);
+            request_result.Key("map").Value(std::move(svg));
+        } else {
+            request_result.Key("error_message").Value("not found"s);
+        }
+        break;
+    }
+    case RequestType::MAP_IMAGE:
+        request_result.Key("png").Value(EncodeBase64(*request_handler.GetMapImage()));
+        break;
+    case RequestType::UNKNOWN:
+        break;
+    }
+
+    return request_result.EndDict().Build();
+}
+
+void PrintStatRequest(const RequestHandler& request_handler, const StatRequest& request,
+                      std::ostream& output) {
+    if (request.type != RequestType::MAP) {
+        ExecuteStatRequest(request_handler, request).Print(output);
+        return;
+    }
+
+    // Карта берётся из кэша уже экранированной и копируется в ответ целиком,
+    // ключи выводятся в порядке json::Dict
+    std::shared_ptr<const RenderedMap> rendered_map;
+    {
+        TC_TIMED_SCOPE(GetRequestLatency(request.type));
+        TC_TRACE_SCOPE_ARG(GetRequestTraceName(request.type), request.id);
+        rendered_map = request_handler.GetRenderedMap();
+    }
+    output << "{\"map\":\""sv;
+    output.write(rendered_map->json_escaped_svg.data(), static_cast<std::streamsize>(rendered_map->json_escaped_svg.size()));
+    output << "\",\"request_id\":"sv << request.id << '}';
+}
+
+namespace {
+
+// Пакет запросов статистики со склейкой одинаковых запросов: ответ на каждый уникальный запрос
+// (тип + параметры) вычисляется один раз, первым из запросов с этим ключом ("ведущим"),
+// а остальные получают копию его ответа со своим request_id
+class StatRequestBatch {
+public:
+    StatRequestBatch(const json::Array& stat_requests, bool is_map_coalesced)
+        : request_groups_(stat_requests.size(), nullptr)
+    {
+        requests_.reserve(stat_requests.size());
+        for (const auto& request : stat_requests) {
+            requests_.push_back(ParseStatRequest(request));
+        }
+
+        std::unordered_map<std::string, size_t> first_requests;
+        std::vector<size_t> leader_of(requests_.size());
+        for (size_t i = 0; i < requests_.size(); ++i) {
+            const auto& request = requests_[i];
+            leader_of[i] = i;
+            if (request.type == RequestType::UNKNOWN || (request.type == RequestType::MAP && !is_map_coalesced)) {
+                continue;
             }
-        } else if (request_map.at("type").AsString() == "Map"s) {
-            std::ostringstream out; 
-            request_handler.RenderMap().Render(out);
-            request_result.Key("map").Value(out.str());
-        } else if (request_map.at("type").AsString() == "Route"s) {
-            auto route_stat = request_handler.FindRoute(request_map.at("from").AsString(), 
-                                                        request_map.at("to").AsString());
-            if (route_stat) {
-                json::Builder items;
-                items.StartArray();
-                for (const auto& item : (*route_stat).items) {
-                    json::Builder item_as_dict;
-                    item_as_dict.StartDict();
-                    if (holds_alternative<RouteInfo::WaitingOnStopItem>(item)) {
-                        const auto& waiting_on_stop_item = get<RouteInfo::WaitingOnStopItem>(item);
-                        item_as_dict
-                            .Key("type").Value("Wait"s)
-                            .Key("stop_name").Value(std::string(waiting_on_stop_item.stop->id))
-                            .Key("time").Value(waiting_on_stop_item.time);
-                    } else {
-                        const auto& bus_item = get<RouteInfo::BusItem>(item);
-                        item_as_dict
-                            .Key("type").Value("Bus"s)
-                            .Key("bus").Value(std::string(bus_item.bus->id))
-                            .Key("time").Value(bus_item.time)
-                            .Key("span_count").Value(static_cast<int>(bus_item.span_count));
+            leader_of[i] = first_requests.emplace(MakeKey(request), i).first->second;
+        }
+        for (size_t i = 0; i < requests_.size(); ++i) {
+            if (leader_of[i] == i) {
+                continue;
+            }
+            auto& group = request_groups_[leader_of[i]];
+            if (!group) {
+                group = &groups_.emplace_back();
+                group->leader = leader_of[i];
+                group->response = group->response_promise.get_future().share();
+            }
+            request_groups_[i] = group;
+            ++group->pending_count;
+        }
+        stats_.request_count = requests_.size();
+        stats_.computed_count = first_requests.size()
+                              + std::count_if(requests_.begin(), requests_.end(), [is_map_coalesced](const auto& r) {
+                                    return r.type == RequestType::UNKNOWN || (r.type == RequestType::MAP && !is_map_coalesced);
+                                });
+    }
+
+    size_t GetSize() const {
+        return requests_.size();
+    }
+
+    const StatBatchStats& GetStats() const {
+        return stats_;
+    }
+
+    // Вычисляет ответ на запрос. Повторный запрос ждёт ответа ведущего, который стоит раньше в пакете
+    json::Node Execute(const RequestHandler& request_handler, size_t index) {
+        DuplicateGroup* group = request_groups_[index];
+        if (!group) {
+            return ExecuteStatRequest(request_handler, requests_[index]);
+        }
+        if (group->leader == index) {
+            try {
+                json::Node response = ExecuteStatRequest(request_handler, requests_[index]);
+                group->response_promise.set_value(response);
+                return response;
+            } catch (...) {
+                group->response_promise.set_exception(std::current_exception());
+                throw;
+            }
+        }
+
+        json::Node response = group->response.get();
+        std::get<json::Dict>(response.GetValue())["request_id"] = requests_[index].id;
+        if (--group->pending_count == 0) {
+            // Последний повтор забрал ответ: копия ведущего больше не нужна
+            group->response = {};
+        }
+        return response;
+    }
+
+    void Print(const RequestHandler& request_handler, size_t index, std::ostream& output) {
+        if (!request_groups_[index]) {
+            PrintStatRequest(request_handler, requests_[index], output);
+        } else {
+            Execute(request_handler, index).Print(output);
+        }
+    }
+
+    // Снимает ожидание с повторов ведущих запросов [begin, end), которые не будут выполнены из-за ошибки
+    void Cancel(size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            if (request_groups_[i] && request_groups_[i]->leader == i) {
+                request_groups_[i]->response_promise.set_exception(
+                    std::make_exception_ptr(std::runtime_error("stat request was cancelled")));
+            }
+        }
+    }
+
+private:
+    struct DuplicateGroup {
+        size_t leader = 0;
+        std::promise<json::Node> response_promise;
+        std::shared_future<json::Node> response;
+        std::atomic<size_t> pending_count{0};
+    };
+
+    static std::string MakeKey(const StatRequest& request) {
+        std::string key(1, static_cast<char>(request.type));
+        key.append(request.name).push_back('\0');
+        key.append(request.from).push_back('\0');
+        key.append(request.to).push_back('\0');
+        key.append(std::to_string(request.zoom)).push_back('/');
+        key.append(std::to_string(request.x)).push_back('/');
+        key.append(std::to_string(request.y));
+        return key;
+    }
+
+    std::vector<StatRequest> requests_;
+    std::deque<DuplicateGroup> groups_;
+    std::vector<DuplicateGroup*> request_groups_;
+    StatBatchStats stats_;
+};
+
+}  // namespace
+
+StatBatchStats ExecuteStatRequests(const RequestHandler& request_handler, const json::Document& doc, std::ostream& output,
+                                   size_t thread_count) {
+    TC_PHASE_SCOPE("stat_requests"sv);
+
+    // Карты не склеиваются: они выводятся из кэша и не собираются в json::Node
+    StatRequestBatch batch(doc.GetRoot().AsDict().at("stat_requests").AsArray(), false);
+
+    if (thread_count <= 1) {
+        output << '[';
+        for (size_t i = 0; i < batch.GetSize(); ++i) {
+            if (i != 0) {
+                output << ',';
+            }
+            batch.Print(request_handler, i, output);
+        }
+        output << ']';
+        return batch.GetStats();
+    }
+
+    // Запросы выполняются кусками: каждый поток берёт следующий свободный кусок
+    // и выводит ответы в свой буфер, буферы выводятся строго в порядке запросов
+    static constexpr size_t chunk_size = 32;
+    struct ChunkResult {
+        std::string text;
+        std::exception_ptr error;
+        bool is_ready = false;
+    };
+    const size_t chunk_count = (batch.GetSize() + chunk_size - 1) / chunk_size;
+    std::vector<ChunkResult> chunk_results(chunk_count);
+    std::atomic<size_t> next_chunk{0};
+    std::mutex chunk_mutex;
+    std::condition_variable chunk_ready;
+
+    auto worker = [&]() {
+        for (size_t chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++) {
+            std::ostringstream out;
+            std::exception_ptr error;
+            const size_t end = std::min(batch.GetSize(), (chunk + 1) * chunk_size);
+            for (size_t i = chunk * chunk_size; i < end; ++i) {
+                try {
+                    if (i != 0) {
+                        out << ',';
                     }
-                    items.Value(item_as_dict
-                                .EndDict()
-                                .Build().GetValue());
+                    batch.Print(request_handler, i, out);
+                } catch (...) {
+                    error = std::current_exception();
+                    batch.Cancel(i + 1, end);
+                    break;
                 }
-                request_result
-                    .Key("total_time").Value((*route_stat).total_time)
-                    .Key("items").Value(items
-                                        .EndArray()
-                                        .Build().GetValue());
-            } else {
-                request_result.Key("error_message").Value("not found"s);
+            }
+            {
+                std::lock_guard lock(chunk_mutex);
+                chunk_results[chunk].text = std::move(out).str();
+                chunk_results[chunk].error = error;
+                chunk_results[chunk].is_ready = true;
+            }
+            chunk_ready.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    thread_count = std::max<size_t>(1, std::min(thread_count, chunk_count));
+    workers.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers.emplace_back(worker);
+    }
+
+    std::exception_ptr error;
+    output << '[';
+    for (auto& chunk_result : chunk_results) {
+        std::unique_lock lock(chunk_mutex);
+        chunk_ready.wait(lock, [&chunk_result]() { return chunk_result.is_ready; });
+        if (chunk_result.error) {
+            // Остальные куски не нужны: останавливаем раздачу и ждём потоки
+            error = chunk_result.error;
+            next_chunk = chunk_count;
+            break;
+        }
+        output << chunk_result.text;
+        chunk_result.text = std::string{};
+    }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    output << ']';
+    return batch.GetStats();
+}
+
+void PrintStatRequestLine(const RequestHandler& request_handler, const std::string& line,
+                          std::ostream& output) {
+    // Документ запроса живёт до конца вывода ответа: строки запроса ссылаются на него.
+    // Ответ выводится только после выполнения запроса, поэтому при ошибке вывод ещё пуст
+    std::optional<json::Document> request;
+    try {
+        std::istringstream line_input(line);
+        request.emplace(json::Load(line_input));
+        PrintStatRequest(request_handler, ParseStatRequest(request->GetRoot()), output);
+    } catch (const std::exception& e) {
+        // Клиент сопоставляет ответы с запросами по request_id: его нет, только если строка
+        // не разобралась как JSON или в запросе нет числового id
+        json::Builder response;
+        response.StartDict().Key("error_message").Value(std::string(e.what()));
+        if (request && request->GetRoot().IsDict()) {
+            const auto& request_dict = request->GetRoot().AsDict();
+            if (const auto id = request_dict.find("id"); id != request_dict.end() && id->second.IsInt()) {
+                response.Key("request_id").Value(id->second.AsInt());
             }
         }
+        response.EndDict().Build().Print(output);
+    }
+}
+
+void ServeStatRequests(const RequestHandler& request_handler, std::istream& input, std::ostream& output) {
+    std::string line;
+    while (std::getline(input, line)) {
+        if (std::all_of(line.begin(), line.end(), [](unsigned char ch) { return std::isspace(ch); })) {
+            continue;
+        }
+        PrintStatRequestLine(request_handler, line, output);
 
-        request_results.Value(std::move(request_result
-                                        .EndDict()
-                                        .Build().GetValue()));
+        // Ответ отдаём сразу, не дожидаясь следующих запросов
+        output << '\n' << std::flush;
+    }
+}
+
+json::Document ExecuteStatRequests(const RequestHandler& request_handler, const json::Document& doc) {
+    StatRequestBatch batch(doc.GetRoot().AsDict().at("stat_requests").AsArray(), true);
+
+    // Обрабатываем запросы
+    json::Builder request_results;
+    request_results.StartArray();
+    for (size_t i = 0; i < batch.GetSize(); ++i) {
+        request_results.Value(std::move(batch.Execute(request_handler, i).GetValue()));
     }
 
     return json::Document(request_results
@@ -206,6 +658,7 @@ namespace utils {
 }  // namespace renderer::utils
 
 void FillMapRenderer(MapRenderer& map_renderer, const json::Document & doc) {
+    TC_PHASE_SCOPE("fill_map_renderer"sv);
     auto settings_map(doc.GetRoot().AsDict().at("render_settings").AsDict());
     MapRenderer::RenderSettings settings{
         settings_map.at("width").AsDouble(),
@@ -227,6 +680,18 @@ void FillMapRenderer(MapRenderer& map_renderer, const json::Document & doc) {
         settings_map.at("underlayer_width").AsDouble(),
         utils::JSONNodeToColors(settings_map.at("color_palette"))
     };
+    if (const auto tolerance = settings_map.find("simplification_tolerance"); tolerance != settings_map.end()) {
+        settings.simplification_tolerance = tolerance->second.AsDouble();
+    }
+    if (const auto compact = settings_map.find("compact_svg"); compact != settings_map.end()) {
+        settings.compact_svg = compact->second.AsBool();
+    }
+    if (const auto precision = settings_map.find("svg_precision"); precision != settings_map.end()) {
+        settings.svg_precision = precision->second.AsInt();
+    }
+    if (const auto culling = settings_map.find("label_culling"); culling != settings_map.end()) {
+        settings.label_culling = culling->second.AsBool();
+    }
     map_renderer.SetRenderSettings(std::move(settings));
 }
 
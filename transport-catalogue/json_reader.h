@@ -5,6 +5,10 @@
 #include "transport_catalogue.h"
 
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 /*
  * Код наполнения транспортного справочника данными из JSON,
@@ -13,6 +17,100 @@
 
 namespace transport {
 
+// Тип запроса (поле "type"), порядок совпадает с таблицей ключей в json_reader.cpp
+enum class RequestType : uint8_t {
+    STOP,
+    BUS,
+    ROUTE,
+    MAP,
+    STATS,
+    MAP_TILE,
+    MAP_IMAGE,
+    UNKNOWN,
+};
+
+// Запрос на создание остановки (base_requests), строки ссылаются на исходный JSON документ
+struct StopRequest {
+    std::string_view name;
+    geo::Coordinates coordinates{};
+    std::vector<std::pair<std::string_view, int>> road_distances;
+};
+
+// Запрос на создание маршрута (base_requests)
+struct BusRequest {
+    std::string_view name;
+    std::vector<std::string_view> stops;
+    bool is_roundtrip = false;
+};
+
+// Запрос статистики (stat_requests): name для Bus/Stop, from/to для Route, zoom/x/y для MapTile
+struct StatRequest {
+    int id = 0;
+    RequestType type = RequestType::UNKNOWN;
+    std::string_view name;
+    std::string_view from;
+    std::string_view to;
+    int zoom = 0;
+    int x = 0;
+    int y = 0;
+};
+
+// Статистика пакета запросов: одинаковые запросы вычисляются один раз
+struct StatBatchStats {
+    size_t request_count = 0;
+    size_t computed_count = 0;
+};
+
+// Разбирает запрос статистики за один проход по словарю
+StatRequest ParseStatRequest(const json::Node& request);
+
+// Выполняет один запрос статистики и возвращает ответ на него
+json::Node ExecuteStatRequest(const RequestHandler& request_handler,
+                              const StatRequest& request);
+
+// Выполняет один запрос статистики и сразу выводит ответ в поток.
+// SVG карта запроса Map копируется в поток из кэша уже экранированной
+void PrintStatRequest(const RequestHandler& request_handler,
+                      const StatRequest& request,
+                      std::ostream& output);
+
+// Разбирает и выполняет запрос статистики, записанный одной строкой JSON, и выводит ответ в поток.
+// Если строку не удалось разобрать или выполнить, выводится ответ с error_message
+// (и request_id, если строка разобралась как JSON и в ней есть числовой id)
+void PrintStatRequestLine(const RequestHandler& request_handler,
+                          const std::string& line,
+                          std::ostream& output);
+
+// Обслуживает поток запросов статистики в формате NDJSON: каждая строка input - один запрос,
+// на каждую выводится строка ответа в output (со сбросом потока). Ошибочная строка получает
+// ответ с error_message, обработка продолжается до конца input
+void ServeStatRequests(const RequestHandler& request_handler,
+                       std::istream& input,
+                       std::ostream& output);
+
+// Пошаговое заполнение каталога запросами base_requests: остановки добавляются сразу,
+// расстояния и маршруты - в Finish, когда известны все остановки.
+// Узлы запросов должны жить до вызова Finish: разобранные запросы ссылаются на их строки
+class BaseRequestsIngestor {
+public:
+    explicit BaseRequestsIngestor(TransportCatalogue& db);
+
+    void Add(const json::Node& base_request);
+    void Finish();
+
+private:
+    void SetStopDistances();
+    void AddBuses();
+
+    TransportCatalogue& db_;
+    std::vector<StopRequest> stop_requests_;
+    std::vector<BusRequest> bus_requests_;
+};
+
+// Устанавливает в каталоге настройки маршрутов (routing_settings)
+void FillRoutingSettings(TransportCatalogue& db,
+                         const json::Document& doc);
+
 // Заполняет данные в транспортном каталоге
 void FillTransportCatalogue(TransportCatalogue& db, 
                             const json::Document& doc);
@@ -21,6 +119,13 @@ void FillTransportCatalogue(TransportCatalogue& db,
 json::Document ExecuteStatRequests(const RequestHandler& request_handler, 
                                    const json::Document& doc);
 
+// Выполняет запросы статистики и выводит массив ответов в поток по мере выполнения.
+// При thread_count > 1 запросы выполняются параллельно, порядок ответов сохраняется
+StatBatchStats ExecuteStatRequests(const RequestHandler& request_handler, 
+                                   const json::Document& doc,
+                                   std::ostream& output,
+                                   size_t thread_count = 1);
+
 }  // namespace transport
 
 namespace renderer {
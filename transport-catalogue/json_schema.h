@@ -0,0 +1,135 @@
+#pragma once
+
+#include "json.h"
+
+#include <array>
+#include <bit>
+#include <bitset>
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/*
+ * Декларативное связывание ключей JSON-словаря с полями C++ структуры.
+ * Ключи раскладываются по таблице идеального хеширования во время компиляции,
+ * поэтому словарь разбирается за один проход без поиска полей по имени.
+ */
+
+namespace json::schema {
+
+// FNV-1a с "солью" и перемешиванием старших битов в младшие (по ним выбирается слот).
+// Соль подбирается во время компиляции так, чтобы ключи таблицы не пересекались
+constexpr uint32_t HashKey(std::string_view key, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (char ch : key) {
+        hash ^= static_cast<uint8_t>(ch);
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+// Таблица идеального хеширования для фиксированного набора ключей
+template <size_t N>
+class KeyTable {
+    static_assert(N > 0 && N < 255, "KeyTable supports from 1 to 254 keys");
+
+public:
+    constexpr explicit KeyTable(const std::array<std::string_view, N>& keys)
+        : keys_(keys)
+    {
+        for (uint32_t seed = 0; seed < MAX_SEED; ++seed) {
+            if (TryPlaceKeys(seed)) {
+                seed_ = seed;
+                return;
+            }
+        }
+        // В constexpr-контексте превращается в ошибку компиляции
+        throw std::logic_error("KeyTable: perfect hash seed not found");
+    }
+
+    // Возвращает индекс ключа в таблице или N, если ключ неизвестен
+    constexpr size_t Find(std::string_view key) const {
+        const uint8_t index = slots_[HashKey(key, seed_) & (SLOT_COUNT - 1)];
+        return (index != EMPTY_SLOT && keys_[index] == key) ? index : N;
+    }
+
+private:
+    constexpr bool TryPlaceKeys(uint32_t seed) {
+        slots_.fill(EMPTY_SLOT);
+        for (size_t i = 0; i < N; ++i) {
+            auto& slot = slots_[HashKey(keys_[i], seed) & (SLOT_COUNT - 1)];
+            if (slot != EMPTY_SLOT) {
+                return false;
+            }
+            slot = static_cast<uint8_t>(i);
+        }
+        return true;
+    }
+
+    static constexpr size_t SLOT_COUNT = std::bit_ceil(N * 2);
+    static constexpr uint8_t EMPTY_SLOT = 0xFF;
+    static constexpr uint32_t MAX_SEED = 1u << 16;
+
+    std::array<std::string_view, N> keys_;
+    std::array<uint8_t, SLOT_COUNT> slots_{};
+    uint32_t seed_ = 0;
+};
+
+// Привязка ключей словаря к обработчикам полей структуры Record
+template <typename Record, size_t N>
+class Binding {
+public:
+    using Setter = void (*)(Record&, const Node&);
+    // Ключи, найденные в словаре: бит i соответствует полю fields[i]
+    using KeySet = std::bitset<N>;
+    struct Field {
+        std::string_view key;
+        Setter set;
+    };
+
+    constexpr explicit Binding(const std::array<Field, N>& fields)
+        : fields_(fields)
+        , keys_(KeysOf(fields))
+    {}
+
+    // Заполняет поля структуры за один проход по словарю, неизвестные ключи пропускаются.
+    // Возвращает набор найденных ключей
+    KeySet Decode(const Dict& dict, Record& record) const {
+        KeySet seen;
+        for (const auto& [key, value] : dict) {
+            if (const size_t index = keys_.Find(key); index != N) {
+                fields_[index].set(record, value);
+                seen.set(index);
+            }
+        }
+        return seen;
+    }
+
+    // Бросает std::out_of_range, как Dict::at, если какого-то из ключей keys не было в словаре
+    void Require(const KeySet& seen, std::initializer_list<std::string_view> keys) const {
+        for (const auto key : keys) {
+            if (const size_t index = keys_.Find(key); index == N || !seen.test(index)) {
+                throw std::out_of_range(std::string("missing required key \"").append(key).append("\""));
+            }
+        }
+    }
+
+private:
+    static constexpr std::array<std::string_view, N> KeysOf(const std::array<Field, N>& fields) {
+        std::array<std::string_view, N> keys;
+        for (size_t i = 0; i < N; ++i) {
+            keys[i] = fields[i].key;
+        }
+        return keys;
+    }
+
+    std::array<Field, N> fields_;
+    KeyTable<N> keys_;
+};
+
+}  // namespace json::schema
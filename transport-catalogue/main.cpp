@@ -1,18 +1,199 @@
+#include "instrumentation.h"
 #include "json.h"
+#include "json_builder.h"
+#include "json_msgpack.h"
 #include "json_reader.h"
 #include "map_renderer.h"
+#include "query_server.h"
 #include "request_handler.h"
+#include "startup_pipeline.h"
+#include "tracing.h"
 #include "transport_catalogue.h"
 
+#include <algorithm>
 #include <cassert>
+#include <charconv>
+#include <csignal>
+#include <cstdint>
+#include <fstream>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
 
 using namespace std;
 
-int main() {
+namespace {
+
+// Сервер, который останавливается по SIGINT/SIGTERM
+QueryServer* running_server = nullptr;
+
+void StopServer(int) {
+    if (running_server) {
+        running_server->Stop();
+    }
+}
+
+// Разбирает размер бюджета памяти в мебибайтах; nullopt, если это не число или в байтах
+// оно не помещается в size_t
+std::optional<size_t> ParseMebibytes(std::string_view value) {
+    size_t mebibytes = 0;
+    const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), mebibytes);
+    if (value.empty() || error != std::errc{} || end != value.data() + value.size() || mebibytes > (SIZE_MAX >> 20)) {
+        return std::nullopt;
+    }
+    return mebibytes << 20;
+}
+
+// Печатает отчёт инструментации и памяти в stderr (пустой путь) или в файл
+void WriteStatsReport(const std::string& path, const RequestHandler& request_handler) {
+    const auto memory_usage = request_handler.GetMemoryUsage();
+    if (path.empty()) {
+        instrumentation::Registry::Instance().PrintReport(std::cerr, &memory_usage);
+        return;
+    }
+    std::ofstream report_file(path);
+    instrumentation::Registry::Instance().PrintReport(report_file, &memory_usage);
+}
+
+// Сохраняет трассировку в формате Chrome trace_event (открывается в Perfetto)
+void WriteTrace(const std::string& path) {
+    std::ofstream trace_file(path);
+    tracing::Tracer::Instance().WriteChromeTrace(trace_file);
+}
+
+int Run(int argc, char* argv[]) {
+    // Параметры запуска:
+    //  --parallel-parse разбирает массивы запросов в нескольких потоках
+    //  --parallel-execute выполняет запросы статистики в нескольких потоках
+    //  --parallel-render рендерит карту в нескольких потоках
+    //  --msgpack-input/--msgpack-output читают/пишут MessagePack вместо текстового JSON
+    //  --batch-stats выводит в stderr статистику пакета запросов
+    //  --ndjson после базового документа читает из stdin запросы статистики по одному в строке
+    //           и отвечает на каждый строкой в stdout, пока не закончится ввод
+    //  --pipeline разбирает документ, наполняет каталог, строит граф маршрутов и карту
+    //             и отвечает на запросы одновременно (вместо последовательных этапов);
+    //             читает только текстовый JSON и отвечает массивом, потоки задаёт --parallel-execute
+    //  --stats-report[=<path>] при выходе печатает в stderr (или в файл) время этапов запуска
+    //                          и распределение задержек по типам запросов в формате JSON
+    //  --trace=<path> записывает при выходе временную шкалу этапов и запросов по потокам
+    //                 в формате Chrome trace_event (для Perfetto / chrome://tracing)
+    //  --memory-budget=<MiB> ограничивает память таблицы кратчайших путей; если таблица не помещается,
+    //                       маршруты ищутся без предрасчёта (или процесс завершается при
+    //                       --memory-budget-policy=fail)
+    //  --socket=<path> после базового документа обслуживает запросы NDJSON на Unix domain socket
+    bool is_parallel_parse = false;
+    bool is_parallel_execute = false;
+    bool is_parallel_render = false;
+    bool is_batch_stats = false;
+    bool is_ndjson = false;
+    bool is_pipeline = false;
+    std::string socket_path;
+    bool is_msgpack_input = false;
+    bool is_msgpack_output = false;
+    bool is_stats_report = false;
+    std::string stats_report_path;
+    memory::Budget memory_budget;
+    std::string trace_path;
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i] == "--parallel-parse"sv) {
+            is_parallel_parse = true;
+        } else if (argv[i] == "--parallel-execute"sv) {
+            is_parallel_execute = true;
+        } else if (argv[i] == "--parallel-render"sv) {
+            is_parallel_render = true;
+        } else if (argv[i] == "--batch-stats"sv) {
+            is_batch_stats = true;
+        } else if (argv[i] == "--ndjson"sv) {
+            is_ndjson = true;
+        } else if (argv[i] == "--pipeline"sv) {
+            is_pipeline = true;
+        } else if (std::string_view(argv[i]).substr(0, "--socket="sv.size()) == "--socket="sv) {
+            socket_path = std::string_view(argv[i]).substr("--socket="sv.size());
+        } else if (argv[i] == "--stats-report"sv) {
+            is_stats_report = true;
+        } else if (std::string_view(argv[i]).substr(0, "--stats-report="sv.size()) == "--stats-report="sv) {
+            is_stats_report = true;
+            stats_report_path = std::string_view(argv[i]).substr("--stats-report="sv.size());
+        } else if (std::string_view(argv[i]).substr(0, "--memory-budget="sv.size()) == "--memory-budget="sv) {
+            const auto value = std::string_view(argv[i]).substr("--memory-budget="sv.size());
+            const auto limit_bytes = ParseMebibytes(value);
+            if (!limit_bytes) {
+                std::cerr << "Invalid --memory-budget value: "sv << value << " (expected MiB from 0 to "sv
+                          << (SIZE_MAX >> 20) << ")"sv << std::endl;
+                return 1;
+            }
+            memory_budget.limit_bytes = *limit_bytes;
+        } else if (std::string_view(argv[i]).substr(0, "--memory-budget-policy="sv.size()) == "--memory-budget-policy="sv) {
+            const auto value = std::string_view(argv[i]).substr("--memory-budget-policy="sv.size());
+            if (value == "fail"sv) {
+                memory_budget.policy = memory::Budget::Policy::FAIL;
+            } else if (value == "fallback"sv) {
+                memory_budget.policy = memory::Budget::Policy::FALLBACK;
+            } else {
+                std::cerr << "Invalid --memory-budget-policy value: "sv << value << " (expected fail or fallback)"sv << std::endl;
+                return 1;
+            }
+        } else if (std::string_view(argv[i]).substr(0, "--trace="sv.size()) == "--trace="sv) {
+            trace_path = std::string_view(argv[i]).substr("--trace="sv.size());
+        } else if (argv[i] == "--msgpack-input"sv) {
+            is_msgpack_input = true;
+        } else if (argv[i] == "--msgpack-output"sv) {
+            is_msgpack_output = true;
+        } else {
+            std::cerr << "Unknown argument: "sv << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    if (!trace_path.empty()) {
+        tracing::Tracer::Instance().Enable();
+    }
+
+    if (is_pipeline) {
+        // Конвейер сам разбирает вход потоково и рендерит карту в потоках выполнения запросов:
+        // режимы ввода и вывода остальных путей в нём не поддерживаются
+        const std::pair<std::string_view, bool> unsupported_options[] = {
+            {"--parallel-parse"sv, is_parallel_parse},
+            {"--parallel-render"sv, is_parallel_render},
+            {"--batch-stats"sv, is_batch_stats},
+            {"--ndjson"sv, is_ndjson},
+            {"--socket"sv, !socket_path.empty()},
+            {"--msgpack-input"sv, is_msgpack_input},
+            {"--msgpack-output"sv, is_msgpack_output},
+        };
+        for (const auto& [option, is_set] : unsupported_options) {
+            if (is_set) {
+                std::cerr << "--pipeline cannot be combined with "sv << option << std::endl;
+                return 1;
+            }
+        }
+        transport::RunPipeline(std::cin, std::cout,
+                               is_parallel_execute ? std::thread::hardware_concurrency() : 1,
+                               memory_budget,
+                               [&](const RequestHandler& request_handler) {
+                                   if (is_stats_report) {
+                                       WriteStatsReport(stats_report_path, request_handler);
+                                   }
+                               });
+        if (!trace_path.empty()) {
+            WriteTrace(trace_path);
+        }
+        return 0;
+    }
+
     // Считываем JSON из stdin
-    json::Document json_doc(json::Load(std::cin));
+    json::Document json_doc([&]() {
+        TC_PHASE_SCOPE("json_load"sv);
+        return is_msgpack_input
+               ? json::LoadMsgPack(std::cin)
+               : is_parallel_parse
+               ? json::LoadParallel(std::cin, std::thread::hardware_concurrency())
+               : json::Load(std::cin);
+    }());
     
     // Обрабатываем запросы на создание данных транспортного каталога (ТК)
     transport::TransportCatalogue db;
@@ -21,15 +202,59 @@ int main() {
     // Обрабатываем настройки для визуализации ТК
     renderer::MapRenderer map_renderer;
     renderer::FillMapRenderer(map_renderer, json_doc);
+    if (is_parallel_render) {
+        map_renderer.SetThreadCount(std::thread::hardware_concurrency());
+    }
     
     // Обработчик запросов
-    RequestHandler request_handler(db, map_renderer);
+    RequestHandler request_handler(db, map_renderer, RouterBuildMode::IMMEDIATE, memory_budget);
+    request_handler.RecordMemoryUsage("json_dom", json::GetHeapBytes(json_doc.GetRoot()));
 
-    // Обработка запросов к ТК
-    json::Document requests_result(transport::ExecuteStatRequests(request_handler, json_doc));
-    
-    //Печатаем результаты запросов к ТК
-    json::Print(requests_result, std::cout);
+    // Обработка запросов к ТК и печать результатов
+    if (!socket_path.empty()) {
+        QueryServer server(request_handler, socket_path, std::max(1u, std::thread::hardware_concurrency()));
+        running_server = &server;
+        std::signal(SIGINT, StopServer);
+        std::signal(SIGTERM, StopServer);
+        server.Run();
+        running_server = nullptr;
+    } else if (is_ndjson) {
+        // Каталог, граф маршрутов и кэш карты остаются в памяти между запросами
+        transport::ServeStatRequests(request_handler, std::cin, std::cout);
+    } else if (is_msgpack_output) {
+        json::Document requests_result(transport::ExecuteStatRequests(request_handler, json_doc));
+        json::PrintMsgPack(requests_result, std::cout);
+    } else {
+        auto batch_stats = transport::ExecuteStatRequests(request_handler, json_doc, std::cout,
+                                                          is_parallel_execute ? std::thread::hardware_concurrency() : 1);
+        if (is_batch_stats) {
+            json::Print(json::Document(json::Builder{}.StartDict()
+                                           .Key("request_count").Value(static_cast<int>(batch_stats.request_count))
+                                           .Key("computed_count").Value(static_cast<int>(batch_stats.computed_count))
+                                       .EndDict()
+                                       .Build()),
+                        std::cerr);
+            std::cerr << std::endl;
+        }
+    }
+
+    if (is_stats_report) {
+        WriteStatsReport(stats_report_path, request_handler);
+    }
+    if (!trace_path.empty()) {
+        WriteTrace(trace_path);
+    }
 
     return 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        return Run(argc, argv);
+    } catch (const memory::BudgetExceededError& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
 }
\ No newline at end of file
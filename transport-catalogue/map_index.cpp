@@ -0,0 +1,346 @@
+#include "map_index.h"
+
+#include "memory_accounting.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace renderer {
+
+namespace {
+
+// Сетка около одной остановки на ячейку, но не больше MAX_GRID_SIDE x MAX_GRID_SIDE ячеек
+constexpr size_t MAX_GRID_SIDE = 1024;
+
+// Размер области тайлов для сети из одной точки
+constexpr double MIN_TILE_AREA_SIDE = 1e-6;
+
+}  // namespace
+
+size_t CountUtf8Chars(std::string_view text) {
+    return static_cast<size_t>(std::count_if(text.begin(), text.end(), [](char c) {
+        return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+    }));
+}
+
+MapIndex::MapIndex(std::vector<BusPtr> buses, const std::unordered_set<BusPtr>& roundtrip_buses) {
+    // Маршруты и остановки в том же порядке, что и на полной карте
+    std::sort(buses.begin(), buses.end(), [](BusPtr lhs, BusPtr rhs) { return lhs->id < rhs->id; });
+    std::unordered_map<StopPtr, uint32_t> stop_indexes;
+    for (auto bus : buses) {
+        for (auto stop : bus->stops) {
+            if (stop_indexes.emplace(stop, 0).second) {
+                stops_.push_back(stop);
+            }
+        }
+    }
+    std::sort(stops_.begin(), stops_.end(), [](StopPtr lhs, StopPtr rhs) { return lhs->id < rhs->id; });
+    for (uint32_t i = 0; i < stops_.size(); ++i) {
+        stop_indexes[stops_[i]] = i;
+        max_stop_name_length_ = std::max(max_stop_name_length_, CountUtf8Chars(stops_[i]->id));
+    }
+    stop_visits_.assign(stops_.size(), 0);
+
+    for (auto bus : buses) {
+        if (bus->stops.empty()) {
+            continue;
+        }
+        const auto bus_index = static_cast<uint32_t>(buses_.size());
+        buses_.push_back({bus, buses_.size(), static_cast<uint32_t>(route_stops_.size()), static_cast<uint32_t>(bus->stops.size())});
+        max_bus_name_length_ = std::max(max_bus_name_length_, CountUtf8Chars(bus->id));
+        for (auto stop : bus->stops) {
+            route_stops_.push_back(stop_indexes.at(stop));
+            ++stop_visits_[route_stops_.back()];
+        }
+
+        // Подпись у первой остановки и, для некольцевого маршрута, у конечной
+        const auto middle_stop = bus->stops[bus->stops.size() / 2];
+        bus_labels_.push_back({bus_index, stop_indexes.at(bus->stops.front())});
+        if (!roundtrip_buses.count(bus) && bus->stops.front() != middle_stop) {
+            bus_labels_.push_back({bus_index, stop_indexes.at(middle_stop)});
+        }
+    }
+
+    stop_labels_.offsets.assign(stops_.size() + 1, 0);
+    for (const auto& label : bus_labels_) {
+        ++stop_labels_.offsets[label.stop + 1];
+    }
+    std::partial_sum(stop_labels_.offsets.begin(), stop_labels_.offsets.end(), stop_labels_.offsets.begin());
+    stop_labels_.items.resize(bus_labels_.size());
+    std::vector<uint32_t> next_label(stop_labels_.offsets.begin(), stop_labels_.offsets.end() - 1);
+    for (uint32_t i = 0; i < bus_labels_.size(); ++i) {
+        stop_labels_.items[next_label[bus_labels_[i].stop]++] = i;
+    }
+
+    if (!stops_.empty()) {
+        bounds_ = {stops_.front()->coordinates, stops_.front()->coordinates};
+        for (auto stop : stops_) {
+            bounds_.south_west.lat = std::min(bounds_.south_west.lat, stop->coordinates.lat);
+            bounds_.south_west.lng = std::min(bounds_.south_west.lng, stop->coordinates.lng);
+            bounds_.north_east.lat = std::max(bounds_.north_east.lat, stop->coordinates.lat);
+            bounds_.north_east.lng = std::max(bounds_.north_east.lng, stop->coordinates.lng);
+        }
+    }
+    BuildGrid();
+}
+
+const GeoBounds& MapIndex::GetBounds() const {
+    return bounds_;
+}
+
+std::optional<GeoBounds> MapIndex::GetTileBounds(int zoom, int x, int y) const {
+    if (bounds_.IsEmpty() || zoom < 0 || zoom > MAX_TILE_ZOOM) {
+        return std::nullopt;
+    }
+    const long long tile_count = 1ll << zoom;
+    if (x < 0 || y < 0 || x >= tile_count || y >= tile_count) {
+        return std::nullopt;
+    }
+
+    const double area_side = std::max({bounds_.north_east.lat - bounds_.south_west.lat,
+                                       bounds_.north_east.lng - bounds_.south_west.lng,
+                                       MIN_TILE_AREA_SIDE});
+    const double tile_side = area_side / static_cast<double>(tile_count);
+    const double west = bounds_.south_west.lng + tile_side * x;
+    const double north = bounds_.north_east.lat - tile_side * y;
+    return GeoBounds{{north - tile_side, west}, {north, west + tile_side}};
+}
+
+void MapIndex::Query(const GeoBounds& bounds, QueryResult& result) const {
+    result.stops.clear();
+    result.segments.clear();
+    result.bus_labels.clear();
+    if (bounds.IsEmpty() || bounds_.IsEmpty()
+        || bounds.north_east.lat < bounds_.south_west.lat || bounds.south_west.lat > bounds_.north_east.lat
+        || bounds.north_east.lng < bounds_.south_west.lng || bounds.south_west.lng > bounds_.north_east.lng) {
+        return;
+    }
+
+    const CellRange range = GetCellRange(bounds.south_west, bounds.north_east);
+    for (size_t row = range.first_row; row <= range.last_row; ++row) {
+        for (size_t column = range.first_column; column <= range.last_column; ++column) {
+            const size_t cell = row * columns_ + column;
+            for (uint32_t i = cell_stops_.offsets[cell]; i < cell_stops_.offsets[cell + 1]; ++i) {
+                const uint32_t stop = cell_stops_.items[i];
+                const auto coordinates = stops_[stop]->coordinates;
+                if (coordinates.lat >= bounds.south_west.lat && coordinates.lat <= bounds.north_east.lat
+                    && coordinates.lng >= bounds.south_west.lng && coordinates.lng <= bounds.north_east.lng) {
+                    result.stops.push_back(stop);
+                }
+            }
+            result.segments.insert(result.segments.end(),
+                                   cell_segments_.items.begin() + cell_segments_.offsets[cell],
+                                   cell_segments_.items.begin() + cell_segments_.offsets[cell + 1]);
+        }
+    }
+
+    // Каждая остановка лежит в одной ячейке, а длинный отрезок - в нескольких
+    std::sort(result.stops.begin(), result.stops.end());
+    std::sort(result.segments.begin(), result.segments.end());
+    result.segments.erase(std::unique(result.segments.begin(), result.segments.end()), result.segments.end());
+
+    for (uint32_t stop : result.stops) {
+        result.bus_labels.insert(result.bus_labels.end(),
+                                 stop_labels_.items.begin() + stop_labels_.offsets[stop],
+                                 stop_labels_.items.begin() + stop_labels_.offsets[stop + 1]);
+    }
+    std::sort(result.bus_labels.begin(), result.bus_labels.end());
+}
+
+const std::vector<MapIndex::IndexedBus>& MapIndex::GetBuses() const {
+    return buses_;
+}
+
+const std::vector<MapIndex::StopPtr>& MapIndex::GetStops() const {
+    return stops_;
+}
+
+const std::vector<uint32_t>& MapIndex::GetRouteStops() const {
+    return route_stops_;
+}
+
+const std::vector<MapIndex::BusLabel>& MapIndex::GetBusLabels() const {
+    return bus_labels_;
+}
+
+const std::vector<uint32_t>& MapIndex::GetStopVisits() const {
+    return stop_visits_;
+}
+
+size_t MapIndex::GetMaxBusNameLength() const {
+    return max_bus_name_length_;
+}
+
+size_t MapIndex::GetMaxStopNameLength() const {
+    return max_stop_name_length_;
+}
+
+uint32_t MapIndex::GetSegmentBus(uint32_t segment) const {
+    const auto it = std::upper_bound(buses_.begin(), buses_.end(), segment,
+                                     [](uint32_t value, const IndexedBus& bus) { return value < bus.first_stop; });
+    return static_cast<uint32_t>(std::prev(it) - buses_.begin());
+}
+
+RouteDetail MapIndex::SimplifyRoutes(double tolerance) const {
+    RouteDetail detail(route_stops_.size(), false);
+    auto get_point = [this](uint32_t route_stop) {
+        return stops_[route_stops_[route_stop]]->coordinates;
+    };
+    // Квадрат расстояния от точки до отрезка [from, to] на плоскости (долгота, широта)
+    auto get_distance_sq = [](geo::Coordinates point, geo::Coordinates from, geo::Coordinates to) {
+        const double dx = to.lng - from.lng;
+        const double dy = to.lat - from.lat;
+        const double length_sq = dx * dx + dy * dy;
+        double t = length_sq > 0.0 ? ((point.lng - from.lng) * dx + (point.lat - from.lat) * dy) / length_sq : 0.0;
+        t = std::clamp(t, 0.0, 1.0);
+        const double x = from.lng + dx * t - point.lng;
+        const double y = from.lat + dy * t - point.lat;
+        return x * x + y * y;
+    };
+
+    const double tolerance_sq = tolerance * tolerance;
+    std::vector<std::pair<uint32_t, uint32_t>> spans;
+    for (const auto& bus : buses_) {
+        const uint32_t first = bus.first_stop;
+        const uint32_t last = bus.first_stop + bus.stop_count - 1;
+        detail[first] = detail[last] = true;
+
+        // Стек вместо рекурсии: длинные маршруты не переполнят стек вызовов
+        spans.assign(1, {first, last});
+        while (!spans.empty()) {
+            const auto [from, to] = spans.back();
+            spans.pop_back();
+            double max_distance_sq = tolerance_sq;
+            uint32_t farthest = from;
+            for (uint32_t i = from + 1; i < to; ++i) {
+                const double distance_sq = get_distance_sq(get_point(i), get_point(from), get_point(to));
+                if (distance_sq > max_distance_sq) {
+                    max_distance_sq = distance_sq;
+                    farthest = i;
+                }
+            }
+            if (farthest != from) {
+                detail[farthest] = true;
+                spans.emplace_back(from, farthest);
+                spans.emplace_back(farthest, to);
+            }
+        }
+    }
+    return detail;
+}
+
+size_t MapIndex::GetMemoryUsage() const {
+    auto get_cells_bytes = [](const CellLists& cells) {
+        return memory::GetHeapBytes(cells.offsets) + memory::GetHeapBytes(cells.items);
+    };
+    return memory::GetHeapBytes(buses_) + memory::GetHeapBytes(stops_) + memory::GetHeapBytes(route_stops_)
+         + memory::GetHeapBytes(bus_labels_) + memory::GetHeapBytes(stop_visits_) + get_cells_bytes(stop_labels_)
+         + get_cells_bytes(cell_stops_) + get_cells_bytes(cell_segments_);
+}
+
+void MapIndex::BuildGrid() {
+    const auto side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(stops_.size()))));
+    rows_ = columns_ = std::clamp<size_t>(side, 1, MAX_GRID_SIDE);
+    if (!bounds_.IsEmpty()) {
+        cell_lat_ = (bounds_.north_east.lat - bounds_.south_west.lat) / static_cast<double>(rows_);
+        cell_lng_ = (bounds_.north_east.lng - bounds_.south_west.lng) / static_cast<double>(columns_);
+    }
+
+    FillCells(cell_stops_, [this](auto add_item) {
+        for (uint32_t stop = 0; stop < stops_.size(); ++stop) {
+            const auto coordinates = stops_[stop]->coordinates;
+            const CellRange range = GetCellRange(coordinates, coordinates);
+            add_item(stop, range.first_row * columns_ + range.first_column);
+        }
+    });
+
+    // Отрезок попадает только в ячейки, через которые проходит: длинный диагональный отрезок
+    // занимает O(rows + columns) ячеек, а не весь свой описывающий прямоугольник
+    FillCells(cell_segments_, [this](auto add_item) {
+        for (const auto& bus : buses_) {
+            for (uint32_t segment = bus.first_stop; segment + 1 < bus.first_stop + bus.stop_count; ++segment) {
+                ForEachSegmentCell(stops_[route_stops_[segment]]->coordinates,
+                                   stops_[route_stops_[segment + 1]]->coordinates,
+                                   [&](size_t cell) { add_item(segment, cell); });
+            }
+        }
+    });
+}
+
+MapIndex::CellRange MapIndex::GetCellRange(geo::Coordinates min, geo::Coordinates max) const {
+    auto to_cell = [](double value, double origin, double cell_size, size_t cell_count) {
+        if (cell_size <= 0.0 || value <= origin) {
+            return size_t{0};
+        }
+        return std::min(static_cast<size_t>((value - origin) / cell_size), cell_count - 1);
+    };
+    return {to_cell(min.lat, bounds_.south_west.lat, cell_lat_, rows_),
+            to_cell(max.lat, bounds_.south_west.lat, cell_lat_, rows_),
+            to_cell(min.lng, bounds_.south_west.lng, cell_lng_, columns_),
+            to_cell(max.lng, bounds_.south_west.lng, cell_lng_, columns_)};
+}
+
+template <typename AddCell>
+void MapIndex::ForEachSegmentCell(geo::Coordinates from, geo::Coordinates to, AddCell add_cell) const {
+    // Обход сетки (Amanatides-Woo) в координатах ячеек: x - столбцы, y - строки.
+    // На каждом шаге отрезок переходит в соседнюю ячейку через ближайшую по ходу границу
+    auto to_grid = [](double value, double origin, double cell_size) {
+        return cell_size > 0.0 ? (value - origin) / cell_size : 0.0;
+    };
+    const double x0 = to_grid(from.lng, bounds_.south_west.lng, cell_lng_);
+    const double y0 = to_grid(from.lat, bounds_.south_west.lat, cell_lat_);
+    const double dx = std::abs(to_grid(to.lng, bounds_.south_west.lng, cell_lng_) - x0);
+    const double dy = std::abs(to_grid(to.lat, bounds_.south_west.lat, cell_lat_) - y0);
+
+    const CellRange first = GetCellRange(from, from);
+    const CellRange last = GetCellRange(to, to);
+    size_t column = first.first_column;
+    size_t row = first.first_row;
+    const bool is_column_growing = last.first_column > column;
+    const bool is_row_growing = last.first_row > row;
+
+    // Доля отрезка до следующей границы по каждой оси и на ширину одной ячейки
+    constexpr double never = std::numeric_limits<double>::infinity();
+    const double step_x = dx > 0.0 ? 1.0 / dx : never;
+    const double step_y = dy > 0.0 ? 1.0 / dy : never;
+    const double cell_x = static_cast<double>(column);
+    const double cell_y = static_cast<double>(row);
+    double next_x = dx > 0.0 ? (is_column_growing ? cell_x + 1.0 - x0 : x0 - cell_x) * step_x : never;
+    double next_y = dy > 0.0 ? (is_row_growing ? cell_y + 1.0 - y0 : y0 - cell_y) * step_y : never;
+
+    add_cell(row * columns_ + column);
+    // Ось, по которой конечная ячейка уже достигнута, дальше не меняется: ошибки округления
+    // не уводят обход за конец отрезка, и он делает ровно |d column| + |d row| шагов
+    while (column != last.first_column || row != last.first_row) {
+        if (row == last.first_row || (column != last.first_column && next_x < next_y)) {
+            column = is_column_growing ? column + 1 : column - 1;
+            next_x += step_x;
+        } else {
+            row = is_row_growing ? row + 1 : row - 1;
+            next_y += step_y;
+        }
+        add_cell(row * columns_ + column);
+    }
+}
+
+template <typename ForEachItem>
+void MapIndex::FillCells(CellLists& cells, ForEachItem for_each_item) const {
+    // Первый проход считает элементы ячеек, второй раскладывает их по местам;
+    // элементы добавляются по возрастанию, поэтому списки ячеек отсортированы
+    cells.offsets.assign(rows_ * columns_ + 1, 0);
+    for_each_item([&](uint32_t, size_t cell) {
+        ++cells.offsets[cell + 1];
+    });
+    std::partial_sum(cells.offsets.begin(), cells.offsets.end(), cells.offsets.begin());
+
+    cells.items.resize(cells.offsets.back());
+    std::vector<uint32_t> next_item(cells.offsets.begin(), cells.offsets.end() - 1);
+    for_each_item([&](uint32_t item, size_t cell) {
+        cells.items[next_item[cell]++] = item;
+    });
+}
+
+}  // namespace renderer
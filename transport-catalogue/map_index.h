@@ -0,0 +1,161 @@
+#pragma once
+
+#include "domain.h"
+#include "geo.h"
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * Пространственный индекс карты: остановки, отрезки маршрутов и точки подписей маршрутов,
+ * разложенные по равномерной сетке в географических координатах.
+ * Позволяет рендерить часть карты (тайл, произвольную область) за время,
+ * пропорциональное видимому содержимому, а не размеру сети
+ */
+
+namespace renderer {
+
+// Прямоугольник в географических координатах: south_west - минимальные широта и долгота,
+// north_east - максимальные
+struct GeoBounds {
+    geo::Coordinates south_west{0.0, 0.0};
+    geo::Coordinates north_east{0.0, 0.0};
+
+    bool IsEmpty() const {
+        return south_west.lat > north_east.lat || south_west.lng > north_east.lng;
+    }
+
+    // Расширяет прямоугольник на margin градусов во все стороны
+    GeoBounds Expanded(double lat_margin, double lng_margin) const {
+        return {{south_west.lat - lat_margin, south_west.lng - lng_margin},
+                {north_east.lat + lat_margin, north_east.lng + lng_margin}};
+    }
+};
+
+// Тайлы карты: на уровне zoom область сети (квадрат в градусах со стороной, равной
+// большему из её размеров) делится на 2^zoom x 2^zoom тайлов. x растёт на восток, y - на юг
+inline constexpr int MAX_TILE_ZOOM = 24;
+// Сторона тайла в пикселях
+inline constexpr double TILE_SIZE = 256.0;
+
+// Число символов текста в UTF-8 (байты продолжения символов не считаются)
+size_t CountUtf8Chars(std::string_view text);
+
+// Уровень детализации ломаных маршрутов: флаг для каждой вершины MapIndex::GetRouteStops(),
+// оставлена ли она после упрощения. Пустой - оставлены все вершины
+using RouteDetail = std::vector<bool>;
+
+class MapIndex {
+public:
+    using BusPtr = const transport::Bus*;
+    using StopPtr = const transport::Stop*;
+
+    // Маршрут в порядке отрисовки (по названию); пустые маршруты не хранятся
+    struct IndexedBus {
+        BusPtr bus = nullptr;
+        // Номер маршрута среди непустых: по нему выбирается цвет палитры
+        size_t ordinal = 0;
+        // Остановки маршрута - route_stops_[first_stop, first_stop + stop_count)
+        uint32_t first_stop = 0;
+        uint32_t stop_count = 0;
+    };
+
+    // Подпись маршрута у остановки
+    struct BusLabel {
+        uint32_t bus = 0;
+        uint32_t stop = 0;
+    };
+
+    // Найденное в области содержимое; номера отсортированы в порядке отрисовки
+    struct QueryResult {
+        // Номера остановок в GetStops()
+        std::vector<uint32_t> stops;
+        // Отрезок i соединяет GetRouteStops()[i] и GetRouteStops()[i + 1] одного маршрута
+        std::vector<uint32_t> segments;
+        // Номера подписей в GetBusLabels()
+        std::vector<uint32_t> bus_labels;
+    };
+
+    MapIndex(std::vector<BusPtr> buses, const std::unordered_set<BusPtr>& roundtrip_buses);
+
+    // Область всех остановок на маршрутах (пустая, если таких нет)
+    const GeoBounds& GetBounds() const;
+
+    // Область тайла; nullopt, если координаты тайла вне сетки уровня zoom
+    std::optional<GeoBounds> GetTileBounds(int zoom, int x, int y) const;
+
+    // Собирает остановки, подписи и отрезки, которые пересекают bounds (с точностью до ячейки сетки)
+    void Query(const GeoBounds& bounds, QueryResult& result) const;
+
+    const std::vector<IndexedBus>& GetBuses() const;
+    // Остановки на маршрутах, по названию
+    const std::vector<StopPtr>& GetStops() const;
+    // Номера остановок всех маршрутов подряд
+    const std::vector<uint32_t>& GetRouteStops() const;
+    const std::vector<BusLabel>& GetBusLabels() const;
+    // Сколько раз остановка GetStops()[i] встречается в маршрутах
+    const std::vector<uint32_t>& GetStopVisits() const;
+    // Длина самого длинного названия маршрута и остановки в символах: по ним оценивается,
+    // насколько подпись может выступать из-за границы области
+    size_t GetMaxBusNameLength() const;
+    size_t GetMaxStopNameLength() const;
+
+    // Номер маршрута, которому принадлежит отрезок
+    uint32_t GetSegmentBus(uint32_t segment) const;
+
+    // Упрощает ломаные маршрутов алгоритмом Дугласа-Пекера: отброшенные вершины лежат не дальше
+    // tolerance градусов от оставшейся ломаной. Первая и последняя вершины маршрута остаются всегда
+    RouteDetail SimplifyRoutes(double tolerance) const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    // Ячейки, которые пересекает прямоугольник [min, max]
+    struct CellRange {
+        size_t first_row = 0;
+        size_t last_row = 0;
+        size_t first_column = 0;
+        size_t last_column = 0;
+    };
+
+    // Содержимое ячеек подряд: элементы ячейки i - items[offsets[i], offsets[i + 1])
+    struct CellLists {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> items;
+    };
+
+    void BuildGrid();
+    CellRange GetCellRange(geo::Coordinates min, geo::Coordinates max) const;
+    // Вызывает add_cell(cell) для каждой ячейки, через которую проходит отрезок [from, to],
+    // по одному разу, в порядке от from к to
+    template <typename AddCell>
+    void ForEachSegmentCell(geo::Coordinates from, geo::Coordinates to, AddCell add_cell) const;
+
+    // for_each_item(add_item) должен вызвать add_item(item, cell) для всех ячеек каждого элемента,
+    // элементы - по возрастанию
+    template <typename ForEachItem>
+    void FillCells(CellLists& cells, ForEachItem for_each_item) const;
+
+    std::vector<IndexedBus> buses_;
+    std::vector<StopPtr> stops_;
+    std::vector<uint32_t> route_stops_;
+    std::vector<BusLabel> bus_labels_;
+    std::vector<uint32_t> stop_visits_;
+    size_t max_bus_name_length_ = 0;
+    size_t max_stop_name_length_ = 0;
+    // Подписи маршрутов у каждой остановки: bus_labels_ с номерами stop_labels_[offsets[i], offsets[i + 1])
+    CellLists stop_labels_;
+
+    GeoBounds bounds_{{0.0, 0.0}, {-1.0, -1.0}};
+    size_t rows_ = 0;
+    size_t columns_ = 0;
+    double cell_lat_ = 0.0;
+    double cell_lng_ = 0.0;
+    CellLists cell_stops_;
+    CellLists cell_segments_;
+};
+
+}  // namespace renderer
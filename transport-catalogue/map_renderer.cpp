@@ -1,173 +1,734 @@
 #include "map_renderer.h"
 
+#include "memory_accounting.h"
+#include "task_pool.h"
+#include "tracing.h"
+
 #include <array>
-#include <map>
+#include <cmath>
+#include <numeric>
+#include <optional>
 #include <set>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 
 using namespace std::literals;
 
 namespace renderer {
 
+namespace {
+
+// Прямоугольник отсечения в координатах изображения
+struct ClipRect {
+    double min_x = 0.0;
+    double min_y = 0.0;
+    double max_x = 0.0;
+    double max_y = 0.0;
+};
+
+// Видимая часть отрезка и признаки того, что его концы обрезаны
+struct ClippedSegment {
+    svg::Point from;
+    svg::Point to;
+    bool is_start_clipped = false;
+    bool is_end_clipped = false;
+};
+
+// Отсекает отрезок [from, to] прямоугольником (алгоритм Лианга-Барски)
+std::optional<ClippedSegment> ClipSegment(svg::Point from, svg::Point to, const ClipRect& rect) {
+    const double dx = to.x - from.x;
+    const double dy = to.y - from.y;
+    double t_start = 0.0;
+    double t_end = 1.0;
+    // Для каждой границы: p * t <= q
+    const std::array<std::pair<double, double>, 4> bounds{{
+        {-dx, from.x - rect.min_x},
+        {dx, rect.max_x - from.x},
+        {-dy, from.y - rect.min_y},
+        {dy, rect.max_y - from.y},
+    }};
+    for (const auto& [p, q] : bounds) {
+        if (p == 0.0) {
+            if (q < 0.0) {
+                return std::nullopt;
+            }
+            continue;
+        }
+        const double t = q / p;
+        if (p < 0.0) {
+            t_start = std::max(t_start, t);
+        } else {
+            t_end = std::min(t_end, t);
+        }
+        if (t_start > t_end) {
+            return std::nullopt;
+        }
+    }
+    return ClippedSegment{
+        t_start > 0.0 ? svg::Point{from.x + dx * t_start, from.y + dy * t_start} : from,
+        t_end < 1.0 ? svg::Point{from.x + dx * t_end, from.y + dy * t_end} : to,
+        t_start > 0.0,
+        t_end < 1.0};
+}
+
+// Наименьший кусок слоя для параллельного рендера: мельче - накладные расходы больше работы
+constexpr size_t MIN_RENDER_CHUNK_SIZE = 64;
+
+// Приблизительные размеры подписи в долях font-size: средняя ширина символа (у жирного
+// шрифта подписей маршрутов - шире), высота над базовой линией и под ней
+constexpr double LABEL_CHAR_WIDTH = 0.6;
+constexpr double BOLD_LABEL_CHAR_WIDTH = 0.7;
+constexpr double LABEL_ASCENT = 0.8;
+constexpr double LABEL_DESCENT = 0.2;
+
+// Прямоугольник подписи на изображении
+struct LabelBox {
+    double min_x = 0.0;
+    double min_y = 0.0;
+    double max_x = 0.0;
+    double max_y = 0.0;
+    // Остановка, у которой стоит подпись: подписи одной остановки расставлены смещениями
+    // из настроек и друг другу не мешают
+    uint32_t stop = 0;
+};
+
+// Прямоугольник текста с подложкой толщиной halo с каждой стороны
+LabelBox GetLabelBox(svg::Point position, svg::Point offset, double font_size, double char_width,
+                     std::string_view text, double halo, uint32_t stop) {
+    const size_t char_count = CountUtf8Chars(text);
+    const double x = position.x + offset.x;
+    const double y = position.y + offset.y;
+    return {x - halo,
+            y - font_size * LABEL_ASCENT - halo,
+            x + static_cast<double>(char_count) * font_size * char_width + halo,
+            y + font_size * LABEL_DESCENT + halo,
+            stop};
+}
+
+// Занятые подписями прямоугольники, разложенные по квадратным ячейкам (хеш-таблица ячеек):
+// новая подпись сравнивается только с прямоугольниками в своих ячейках
+class LabelGrid {
+public:
+    explicit LabelGrid(double cell_size)
+        : cell_size_(cell_size)
+    {}
+
+    // Занимает прямоугольник, если он не пересекает прямоугольники подписей других остановок
+    bool TryPlace(const LabelBox& box) {
+        const auto [first_x, first_y] = GetCell(box.min_x, box.min_y);
+        const auto [last_x, last_y] = GetCell(box.max_x, box.max_y);
+        for (int32_t y = first_y; y <= last_y; ++y) {
+            for (int32_t x = first_x; x <= last_x; ++x) {
+                const auto cell = cells_.find(GetKey(x, y));
+                if (cell == cells_.end()) {
+                    continue;
+                }
+                for (uint32_t other : cell->second) {
+                    const LabelBox& placed = boxes_[other];
+                    if (placed.stop != box.stop
+                        && placed.min_x < box.max_x && box.min_x < placed.max_x
+                        && placed.min_y < box.max_y && box.min_y < placed.max_y) {
+                        return false;
+                    }
+                }
+            }
+        }
+        const auto id = static_cast<uint32_t>(boxes_.size());
+        boxes_.push_back(box);
+        for (int32_t y = first_y; y <= last_y; ++y) {
+            for (int32_t x = first_x; x <= last_x; ++x) {
+                cells_[GetKey(x, y)].push_back(id);
+            }
+        }
+        return true;
+    }
+
+private:
+    std::pair<int32_t, int32_t> GetCell(double x, double y) const {
+        // Номера ячеек точек далеко за изображением остаются в пределах int32_t
+        constexpr double max_cell = 1e9;
+        return {static_cast<int32_t>(std::clamp(std::floor(x / cell_size_), -max_cell, max_cell)),
+                static_cast<int32_t>(std::clamp(std::floor(y / cell_size_), -max_cell, max_cell))};
+    }
+
+    static uint64_t GetKey(int32_t x, int32_t y) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+    }
+
+    double cell_size_;
+    std::vector<LabelBox> boxes_;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells_;
+};
+
+}  // namespace
+
 MapRenderer::MapRenderer(MapRenderer::RenderSettings render_settings)
     : render_settings_(std::move(render_settings))
 {}
 
 void MapRenderer::SetRenderSettings(MapRenderer::RenderSettings render_settings) {
     std::swap(render_settings_, render_settings);
+    ++version_;
 }
 
-svg::Document MapRenderer::RenderMap(std::vector<BusPtr>&& buses, 
-                                     std::unordered_set<BusPtr>&& roundtrip_buses) const {
-    svg::Document render;
-
-    // Вычисляем данные для проецирования координат
-    std::deque<geo::Coordinates> stops_coordinates;
-    for (auto bus : buses) {
-        for (auto stop : bus->stops) {
-            stops_coordinates.push_back(stop->coordinates);
-        }
-    }
-    SphereProjector sphere_projector(stops_coordinates.begin(),
-                                     stops_coordinates.end(),
-                                     render_settings_.width,
-                                     render_settings_.height,
-                                     render_settings_.padding);
-
-    // Сортируем маршруты в лексиграфическом порядке
-    std::sort(buses.begin(), buses.end(), [](BusPtr lhs, BusPtr rhs){ return lhs->id < rhs->id; });
-
-    // Кэш для хранения SVG точки остановки
-    std::map<StopPtr, svg::Point, StopCmp> stop_to_point;
-
-    // Элементы названий маршрутов для рендеринга 
-    std::vector<svg::Text> bus_names_items;
-    bus_names_items.reserve(buses.size() * 4);
-    
-    // Шаблон элемента названия маршрута
-    svg::Text bus_name_template;
-    bus_name_template.SetOffset(render_settings_.bus_label_offset)
-                     .SetFontSize(render_settings_.bus_label_font_size)
-                     .SetFontFamily("Verdana"s)
-                     .SetFontWeight("bold"s);
-
-    //Рендерим маршруты
-    auto bus_color(render_settings_.color_palette.cbegin());
-    for (auto bus : buses) {
-        if (bus->stops.empty()) {
-            continue;
+uint64_t MapRenderer::GetVersion() const {
+    return version_;
+}
+
+template <typename GetStopPoint>
+LabelPlacement MapRenderer::PlaceLabels(const MapIndex& index, GetStopPoint get_stop_point) const {
+    TC_TRACE_SCOPE("place_labels"sv);
+    const double halo = render_settings_.underlayer_width / 2.0;
+    // Ячейка в две высоты шрифта: подпись обычно задевает несколько ячеек в ряд
+    const double max_font_size = std::max(render_settings_.bus_label_font_size, render_settings_.stop_label_font_size);
+    LabelGrid grid(std::max(1.0, 2.0 * max_font_size));
+
+    const auto& bus_labels = index.GetBusLabels();
+    const size_t stop_count = index.GetStops().size();
+    LabelPlacement placement;
+    placement.bus_labels.resize(bus_labels.size());
+    placement.stop_labels.resize(stop_count);
+
+    // Подписи маршрутов ставятся первыми, в порядке вывода
+    for (size_t i = 0; i < bus_labels.size(); ++i) {
+        const auto& label = bus_labels[i];
+        placement.bus_labels[i] = grid.TryPlace(GetLabelBox(
+            get_stop_point(label.stop), render_settings_.bus_label_offset, render_settings_.bus_label_font_size,
+            BOLD_LABEL_CHAR_WIDTH, index.GetBuses()[label.bus].bus->id, halo, label.stop));
+    }
+
+    // Затем подписи остановок: сначала остановки, где чаще останавливаются маршруты,
+    // при равенстве - в порядке вывода
+    const auto& visits = index.GetStopVisits();
+    std::vector<uint32_t> order(stop_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+        return visits[lhs] > visits[rhs];
+    });
+    for (uint32_t stop : order) {
+        placement.stop_labels[stop] = grid.TryPlace(GetLabelBox(
+            get_stop_point(stop), render_settings_.stop_label_offset, render_settings_.stop_label_font_size,
+            LABEL_CHAR_WIDTH, index.GetStops()[stop]->id, halo, stop));
+    }
+    return placement;
+}
+
+raster::Image MapRenderer::RasterizeMap(const MapGeometry& geometry) const {
+    const auto width = static_cast<uint32_t>(std::ceil(std::max(render_settings_.width, 0.0)));
+    const auto height = static_cast<uint32_t>(std::ceil(std::max(render_settings_.height, 0.0)));
+    return raster::Rasterize(RenderMap(geometry), width, height, thread_count_);
+}
+
+void MapRenderer::RenderSvg(const svg::FlatDocument& document, std::string& svg) const {
+    if (render_settings_.compact_svg) {
+        document.RenderCompact(svg, render_settings_.svg_precision);
+    } else {
+        document.Render(svg);
+    }
+}
+
+void MapRenderer::SetThreadCount(size_t thread_count) {
+    thread_count_ = std::max<size_t>(thread_count, 1);
+}
+
+MapGeometry MapRenderer::ProjectStops(std::shared_ptr<const MapIndex> index) const {
+    MapGeometry geometry;
+
+    // Границы индекса посчитаны по различным остановкам маршрутов: проекция та же,
+    // что и по всем вхождениям остановок
+    const auto& bounds = index->GetBounds();
+    const std::array<geo::Coordinates, 2> corners{bounds.south_west, bounds.north_east};
+    const auto& stops = index->GetStops();
+    const SphereProjector sphere_projector(corners.begin(), bounds.IsEmpty() ? corners.begin() : corners.end(),
+                                           render_settings_.width,
+                                           render_settings_.height,
+                                           render_settings_.padding);
+
+    geometry.stop_points.reserve(stops.size());
+    for (auto stop : stops) {
+        geometry.stop_points.push_back(sphere_projector(stop->coordinates));
+        geometry.text_size += stop->id.size() * 2;
+    }
+    for (const auto& bus : index->GetBuses()) {
+        geometry.text_size += bus.bus->id.size() * 4;
+    }
+    if (render_settings_.simplification_tolerance > 0.0 && !IsZero(sphere_projector.GetZoom())) {
+        TC_TRACE_SCOPE("simplify_routes"sv);
+        geometry.route_detail = index->SimplifyRoutes(render_settings_.simplification_tolerance / sphere_projector.GetZoom());
+    }
+    if (render_settings_.label_culling) {
+        geometry.labels = PlaceLabels(*index, [&geometry](uint32_t stop) {
+            return geometry.stop_points[stop];
+        });
+    }
+    geometry.index = std::move(index);
+    geometry.projector = sphere_projector;
+    return geometry;
+}
+
+svg::FlatDocument MapRenderer::RenderMap(const MapGeometry& geometry) const {
+    const auto& index = *geometry.index;
+
+    svg::FlatDocument render;
+    render.Reserve(index.GetBuses().size() + index.GetBusLabels().size() * 2 + index.GetStops().size() * 3,
+                   index.GetRouteStops().size(),
+                   geometry.text_size);
+    const auto styles = AddDocumentStyles(render);
+    for (auto layer : {MapLayer::ROUTES, MapLayer::BUS_LABELS, MapLayer::STOPS, MapLayer::STOP_LABELS}) {
+        RenderLayer(geometry, layer, 0, GetItemCount(index, layer), styles, render);
+    }
+    return render;
+}
+
+void MapRenderer::RenderMap(const MapGeometry& geometry, std::string& svg) const {
+    if (thread_count_ <= 1 || render_settings_.compact_svg) {
+        RenderSvg(RenderMap(geometry), svg);
+        return;
+    }
+
+    // Каждый слой режется на куски подряд идущих маршрутов или остановок
+    struct Chunk {
+        MapLayer layer;
+        size_t first;
+        size_t last;
+    };
+    std::vector<Chunk> chunks;
+    for (auto layer : {MapLayer::ROUTES, MapLayer::BUS_LABELS, MapLayer::STOPS, MapLayer::STOP_LABELS}) {
+        const size_t item_count = GetItemCount(*geometry.index, layer);
+        const size_t chunk_size = std::max(MIN_RENDER_CHUNK_SIZE, item_count / (thread_count_ * 4));
+        for (size_t first = 0; first < item_count; first += chunk_size) {
+            chunks.push_back({layer, first, std::min(first + chunk_size, item_count)});
+        }
+    }
+
+    // Пул потоков рендерит куски в свои буферы
+    std::vector<std::string> chunk_texts(chunks.size());
+    RunTasks(thread_count_, chunks.size(), [&](size_t index) {
+        svg::FlatDocument fragment;
+        const auto styles = AddDocumentStyles(fragment);
+        RenderLayer(geometry, chunks[index].layer, chunks[index].first, chunks[index].last, styles, fragment);
+        fragment.RenderElements(chunk_texts[index]);
+    });
+
+    // Склеиваем куски в порядке слоёв и элементов
+    size_t svg_size = svg.size();
+    for (const auto& text : chunk_texts) {
+        svg_size += text.size();
+    }
+    svg.reserve(svg_size + 128);
+    svg::FlatDocument::RenderHeader(svg);
+    for (const auto& text : chunk_texts) {
+        svg.append(text);
+    }
+    svg::FlatDocument::RenderFooter(svg);
+}
+
+void MapRenderer::RenderMap(const MapGeometry& geometry, MapFragmentCache& cache, std::string& svg) const {
+    if (render_settings_.compact_svg) {
+        RenderSvg(RenderMap(geometry), svg);
+        return;
+    }
+    // Новая проекция сдвигает все точки карты, новые настройки меняют оформление
+    if (cache.renderer_version != version_ || !(cache.projector == geometry.projector)) {
+        cache.buses.clear();
+        cache.stops.clear();
+        cache.projector = geometry.projector;
+        cache.renderer_version = version_;
+    }
+    const uint64_t generation = ++cache.generation;
+
+    const auto& index = *geometry.index;
+    const auto& buses = index.GetBuses();
+    const auto& stops = index.GetStops();
+    const size_t palette_size = std::max<size_t>(render_settings_.color_palette.size(), 1);
+
+    // Подписи маршрута i - GetBusLabels()[label_offsets[i], label_offsets[i + 1]):
+    // подписи идут подряд в порядке маршрутов
+    std::vector<size_t> label_offsets(buses.size() + 1, 0);
+    for (const auto& label : index.GetBusLabels()) {
+        ++label_offsets[label.bus + 1];
+    }
+    std::partial_sum(label_offsets.begin(), label_offsets.end(), label_offsets.begin());
+
+    // Находим фрагменты в кэше; новые маршруты и остановки, маршруты со сдвинувшимся цветом
+    // и элементы, у которых после отбора подписей изменился набор подписей, рендерятся заново
+    std::vector<MapFragmentCache::BusFragments*> bus_fragments(buses.size());
+    std::vector<size_t> stale_buses;
+    std::vector<bool> visible_labels;
+    for (size_t i = 0; i < buses.size(); ++i) {
+        auto& fragments = cache.buses[buses[i].bus];
+        const size_t palette_index = buses[i].ordinal % palette_size;
+        visible_labels.clear();
+        for (size_t label = label_offsets[i]; label < label_offsets[i + 1]; ++label) {
+            visible_labels.push_back(geometry.labels.IsBusLabelVisible(label));
+        }
+        if (fragments.generation == 0 || fragments.palette_index != palette_index
+            || fragments.visible_labels != visible_labels) {
+            fragments.palette_index = palette_index;
+            fragments.visible_labels = visible_labels;
+            fragments.route.clear();
+            fragments.labels.clear();
+            stale_buses.push_back(i);
         }
+        fragments.generation = generation;
+        bus_fragments[i] = &fragments;
+    }
+    std::vector<MapFragmentCache::StopFragments*> stop_fragments(stops.size());
+    std::vector<size_t> stale_stops;
+    for (size_t i = 0; i < stops.size(); ++i) {
+        auto& fragments = cache.stops[stops[i]];
+        const bool is_label_visible = geometry.labels.IsStopLabelVisible(i);
+        if (fragments.generation == 0 || fragments.is_label_visible != is_label_visible) {
+            fragments.is_label_visible = is_label_visible;
+            fragments.circle.clear();
+            fragments.label.clear();
+            stale_stops.push_back(i);
+        }
+        fragments.generation = generation;
+        stop_fragments[i] = &fragments;
+    }
+    // Маршрутов и остановок, которых больше нет на карте, в этом рендере не было
+    std::erase_if(cache.buses, [generation](const auto& item) { return item.second.generation != generation; });
+    std::erase_if(cache.stops, [generation](const auto& item) { return item.second.generation != generation; });
 
-        // Валидируем цвет маршрута
-        if (bus_color == render_settings_.color_palette.cend()) {
-            bus_color = render_settings_.color_palette.cbegin();
+    // Недостающие фрагменты рендерятся кусками в пуле потоков, каждый в свою строку кэша
+    struct Chunk {
+        bool is_bus_chunk;
+        size_t first;
+        size_t last;
+    };
+    std::vector<Chunk> chunks;
+    for (const auto* stale_items : {&stale_buses, &stale_stops}) {
+        const size_t chunk_size = std::max(MIN_RENDER_CHUNK_SIZE, stale_items->size() / (thread_count_ * 4));
+        for (size_t first = 0; first < stale_items->size(); first += chunk_size) {
+            chunks.push_back({stale_items == &stale_buses, first, std::min(first + chunk_size, stale_items->size())});
         }
-        
-        // Формируем список точек ломаной маршрута
-        std::vector<svg::Point> bus_points;
-        bus_points.reserve(bus->stops.size());
-        for (auto stop : bus->stops) {
-            if (!stop_to_point.count(stop)) {
-                stop_to_point[stop] = sphere_projector(stop->coordinates);
+    }
+    RunTasks(thread_count_, chunks.size(), [&](size_t chunk_index) {
+        const Chunk& chunk = chunks[chunk_index];
+        svg::FlatDocument render;
+        const auto styles = AddDocumentStyles(render);
+        // Фрагмент - элементы одного слоя одного маршрута или одной остановки
+        auto render_fragment = [&](MapLayer layer, size_t first, size_t last, std::string& fragment) {
+            const size_t first_element = render.GetElementCount();
+            RenderLayer(geometry, layer, first, last, styles, render);
+            render.RenderElements(fragment, first_element, render.GetElementCount());
+        };
+        for (size_t i = chunk.first; i < chunk.last; ++i) {
+            if (chunk.is_bus_chunk) {
+                const size_t bus = stale_buses[i];
+                render_fragment(MapLayer::ROUTES, bus, bus + 1, bus_fragments[bus]->route);
+                render_fragment(MapLayer::BUS_LABELS, label_offsets[bus], label_offsets[bus + 1], bus_fragments[bus]->labels);
+            } else {
+                const size_t stop = stale_stops[i];
+                render_fragment(MapLayer::STOPS, stop, stop + 1, stop_fragments[stop]->circle);
+                render_fragment(MapLayer::STOP_LABELS, stop, stop + 1, stop_fragments[stop]->label);
             }
-            bus_points.push_back(stop_to_point.at(stop));
-        }
-
-        // Рендерим ломаную маршрута
-        svg::Polyline bus_polyline;
-        bus_polyline.SetFillColor("none"s)
-                    .SetStrokeWidth(render_settings_.line_width)
-                    .SetStrokeColor(*bus_color)
-                    .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-                    .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-        for (const auto& bus_point : bus_points) {
-            bus_polyline.AddPoint(bus_point);
-        }
-        render.Add(bus_polyline);
-
-        // Рендерим название маршрута
-        // Устанавливаем координаты первой остановки и название маршрута
-        bus_name_template.SetPosition(*bus_points.begin())
-                         .SetData(bus->id);
-
-        // Рендерим подложку названия маршрута
-        svg::Text bus_name_background(bus_name_template);
-        bus_name_background.SetFillColor(render_settings_.underlayer_color)
-                           .SetStrokeColor(render_settings_.underlayer_color)
-                           .SetStrokeWidth(render_settings_.underlayer_width)
-                           .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-                           .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-        bus_names_items.push_back(bus_name_background);
-
-        // Рендерим текст названия маршрута
-        svg::Text bus_name_text(bus_name_template);
-        bus_names_items.push_back(bus_name_text
-                                  .SetFillColor(*bus_color));
-
-                                    
-
-        // Если маршрут не кольцевой и начальная и конечная остановки не совпадают: добавляем название конечной точки маршрута
-        if (!roundtrip_buses.count(bus) 
-            && *bus->stops.begin() != *std::next(bus->stops.begin(), bus->stops.size() / 2)) {
-            bus_names_items.push_back(svg::Text(bus_name_background)
-                                      .SetPosition(bus_points.at(bus_points.size() / 2)));            
-            bus_names_items.push_back(svg::Text(bus_name_text)
-                                      .SetPosition(bus_points.at(bus_points.size() / 2)));
-        }
-
-        // Меняем цвет для след. маршрута
-        bus_color = std::next(bus_color);
-    }
-    for (auto& bus_name_item : bus_names_items) {
-        render.Add(std::move(bus_name_item));
-    }
-    
-    // Элементы названий маршрутов для рендеринга 
-    std::vector<svg::Text> stop_names_items;
-    stop_names_items.reserve(stop_to_point.size() * 2);
-
-    // Шаблон точки остановки
-    svg::Circle stop_circle_template;
-    stop_circle_template.SetRadius(render_settings_.stop_radius)
-                        .SetFillColor("white"s);
-
-    // Шаблон элемента названия остановки
-    svg::Text stop_name_template;
-    stop_name_template.SetOffset(render_settings_.stop_label_offset)
-                      .SetFontSize(render_settings_.stop_label_font_size)
-                      .SetFontFamily("Verdana"s);
-
-    // Рендерим остановки
-    for (const auto& [stop, stop_point] : stop_to_point) {
-        // Рендерим точку остановки
-        render.Add(svg::Circle(stop_circle_template)
-                   .SetCenter(stop_point));
-
-        // Рендерим название остановки
-        // Устанавливаем координаты и название остановки
-        stop_name_template.SetPosition(stop_point)
-                          .SetData(stop->id);
-
-        // Рендерим подложку названия остановки
-        stop_names_items.push_back(svg::Text(stop_name_template)
-                                   .SetFillColor(render_settings_.underlayer_color)
-                                   .SetStrokeColor(render_settings_.underlayer_color)
-                                   .SetStrokeWidth(render_settings_.underlayer_width)
-                                   .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-                                   .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND));
-
-        // Рендерим текст названия остановки
-        stop_names_items.push_back(svg::Text(stop_name_template)
-                                   .SetFillColor("black"s));
-    }
-    for (auto& stop_name_item : stop_names_items) {
-        render.Add(std::move(stop_name_item));
+        }
+    });
+
+    // Склеиваем фрагменты в порядке слоёв и элементов
+    size_t svg_size = svg.size();
+    for (const auto* fragments : bus_fragments) {
+        svg_size += fragments->route.size() + fragments->labels.size();
+    }
+    for (const auto* fragments : stop_fragments) {
+        svg_size += fragments->circle.size() + fragments->label.size();
+    }
+    svg.reserve(svg_size + 128);
+    svg::FlatDocument::RenderHeader(svg);
+    for (const auto* fragments : bus_fragments) {
+        svg.append(fragments->route);
+    }
+    for (const auto* fragments : bus_fragments) {
+        svg.append(fragments->labels);
+    }
+    for (const auto* fragments : stop_fragments) {
+        svg.append(fragments->circle);
+    }
+    for (const auto* fragments : stop_fragments) {
+        svg.append(fragments->label);
+    }
+    svg::FlatDocument::RenderFooter(svg);
+}
+
+svg::FlatDocument MapRenderer::RenderViewport(const MapIndex& index, const GeoBounds& bounds,
+                                              double width, double height,
+                                              const RouteDetail* route_detail,
+                                              const LabelPlacement* network_labels) const {
+    svg::FlatDocument render;
+
+    // Та же проекция, что и у полной карты, но по углам области и без полей
+    const std::array<geo::Coordinates, 2> corners{bounds.south_west, bounds.north_east};
+    const SphereProjector sphere_projector(corners.begin(), corners.end(), width, height, 0.0);
+    if (bounds.IsEmpty() || width <= 0.0 || height <= 0.0 || IsZero(sphere_projector.GetZoom())) {
+        return render;
+    }
+
+    const auto margin = GetViewportMargin(index);
+    const double zoom = sphere_projector.GetZoom();
+    auto query_bounds = bounds.Expanded(margin.around / zoom, margin.around / zoom);
+    query_bounds.south_west.lng -= margin.left_extra / zoom;
+    MapIndex::QueryResult visible;
+    index.Query(query_bounds, visible);
+
+    const auto& buses = index.GetBuses();
+    const auto& stops = index.GetStops();
+    const auto& route_stops = index.GetRouteStops();
+    const auto& bus_labels = index.GetBusLabels();
+    size_t text_size = 0;
+    for (uint32_t label : visible.bus_labels) {
+        text_size += buses[bus_labels[label].bus].bus->id.size() * 2;
+    }
+    for (uint32_t stop : visible.stops) {
+        text_size += stops[stop]->id.size() * 2;
+    }
+    render.Reserve(visible.segments.size() + visible.bus_labels.size() * 2 + visible.stops.size() * 3,
+                   visible.segments.size() * 2, text_size);
+
+    // Подписи отбираются по всей сети в масштабе области, а не среди найденных в ней:
+    // соседние области одного масштаба одинаково решают судьбу подписи на их стыке
+    LabelPlacement own_labels;
+    if (!network_labels) {
+        own_labels = PlaceViewportLabels(index, bounds, width, height);
+        network_labels = &own_labels;
+    }
+
+    const auto styles = AddDocumentStyles(render);
+
+    // Рендерим видимые части маршрутов: подряд идущие видимые отрезки маршрута образуют одну ломаную.
+    // Конец отрезка выводится, когда известно, продолжается ли ломаная: внутренние вершины,
+    // отброшенные упрощением, пропускаются
+    const ClipRect clip_rect{-margin.around, -margin.around, width + margin.around, height + margin.around};
+    uint32_t bus = 0;
+    std::optional<uint32_t> previous_segment;
+    bool is_previous_end_clipped = false;
+    svg::Point pending_point;
+    bool is_pending_droppable = false;
+    for (uint32_t segment : visible.segments) {
+        const auto clipped = ClipSegment(sphere_projector(stops[route_stops[segment]]->coordinates),
+                                         sphere_projector(stops[route_stops[segment + 1]]->coordinates),
+                                         clip_rect);
+        if (!clipped) {
+            continue;
+        }
+        if (segment >= buses[bus].first_stop + buses[bus].stop_count) {
+            bus = index.GetSegmentBus(segment);
+        }
+        if (!previous_segment || *previous_segment + 1 != segment
+            || is_previous_end_clipped || clipped->is_start_clipped) {
+            if (previous_segment) {
+                render.AddPoint(pending_point);
+            }
+            render.AddPolyline(styles.palette[buses[bus].ordinal % styles.palette.size()].polyline);
+            render.AddPoint(clipped->from);
+        } else if (!is_pending_droppable) {
+            render.AddPoint(pending_point);
+        }
+        pending_point = clipped->to;
+        is_pending_droppable = route_detail && !route_detail->empty() && !(*route_detail)[segment + 1]
+                               && !clipped->is_end_clipped;
+        previous_segment = segment;
+        is_previous_end_clipped = clipped->is_end_clipped;
+    }
+    if (previous_segment) {
+        render.AddPoint(pending_point);
+    }
+
+    // Рендерим названия маршрутов: подложка, затем текст
+    for (uint32_t label : visible.bus_labels) {
+        if (!network_labels->IsBusLabelVisible(label)) {
+            continue;
+        }
+        const auto& indexed_bus = buses[bus_labels[label].bus];
+        const svg::Point position = sphere_projector(stops[bus_labels[label].stop]->coordinates);
+        const auto bus_name_style = styles.palette[indexed_bus.ordinal % styles.palette.size()].bus_name;
+        render.AddText(position, render_settings_.bus_label_offset, indexed_bus.bus->id, styles.bus_name_font, styles.underlayer);
+        render.AddText(position, render_settings_.bus_label_offset, indexed_bus.bus->id, styles.bus_name_font, bus_name_style);
+    }
+
+    // Рендерим точки остановок
+    for (uint32_t stop : visible.stops) {
+        render.AddCircle(sphere_projector(stops[stop]->coordinates), render_settings_.stop_radius, styles.stop_circle);
+    }
+
+    // Рендерим названия остановок: подложка, затем текст
+    for (uint32_t stop : visible.stops) {
+        if (!network_labels->IsStopLabelVisible(stop)) {
+            continue;
+        }
+        const svg::Point position = sphere_projector(stops[stop]->coordinates);
+        render.AddText(position, render_settings_.stop_label_offset, stops[stop]->id, styles.stop_name_font, styles.underlayer);
+        render.AddText(position, render_settings_.stop_label_offset, stops[stop]->id, styles.stop_name_font, styles.stop_name);
     }
 
     return render;
 }
 
-}  // namespace renderer
+size_t MapRenderer::GetItemCount(const MapIndex& index, MapLayer layer) {
+    switch (layer) {
+    case MapLayer::ROUTES:
+        return index.GetBuses().size();
+    case MapLayer::BUS_LABELS:
+        return index.GetBusLabels().size();
+    case MapLayer::STOPS:
+    case MapLayer::STOP_LABELS:
+        return index.GetStops().size();
+    }
+    return 0;
+}
+
+void MapRenderer::RenderLayer(const MapGeometry& geometry, MapLayer layer, size_t first, size_t last,
+                              const DocumentStyles& styles, svg::FlatDocument& render) const {
+    const auto& index = *geometry.index;
+    const auto& buses = index.GetBuses();
+    const auto& stops = index.GetStops();
+    switch (layer) {
+    case MapLayer::ROUTES: {
+        // Рендерим ломаные маршрутов, цвета палитры повторяются по кругу
+        const auto& route_stops = index.GetRouteStops();
+        for (size_t i = first; i < last; ++i) {
+            const auto& bus = buses[i];
+            render.AddPolyline(styles.palette[bus.ordinal % styles.palette.size()].polyline);
+            for (uint32_t stop = bus.first_stop; stop < bus.first_stop + bus.stop_count; ++stop) {
+                if (geometry.route_detail.empty() || geometry.route_detail[stop]) {
+                    render.AddPoint(geometry.stop_points[route_stops[stop]]);
+                }
+            }
+        }
+        break;
+    }
+    case MapLayer::BUS_LABELS: {
+        // Рендерим названия маршрутов: подложка, затем текст
+        const auto& bus_labels = index.GetBusLabels();
+        for (size_t i = first; i < last; ++i) {
+            if (!geometry.labels.IsBusLabelVisible(i)) {
+                continue;
+            }
+            const auto& bus = buses[bus_labels[i].bus];
+            const svg::Point position = geometry.stop_points[bus_labels[i].stop];
+            render.AddText(position, render_settings_.bus_label_offset, bus.bus->id, styles.bus_name_font, styles.underlayer);
+            render.AddText(position, render_settings_.bus_label_offset, bus.bus->id, styles.bus_name_font,
+                           styles.palette[bus.ordinal % styles.palette.size()].bus_name);
+        }
+        break;
+    }
+    case MapLayer::STOPS:
+        // Рендерим точки остановок
+        for (size_t i = first; i < last; ++i) {
+            render.AddCircle(geometry.stop_points[i], render_settings_.stop_radius, styles.stop_circle);
+        }
+        break;
+    case MapLayer::STOP_LABELS:
+        // Рендерим названия остановок: подложка, затем текст
+        for (size_t i = first; i < last; ++i) {
+            if (!geometry.labels.IsStopLabelVisible(i)) {
+                continue;
+            }
+            render.AddText(geometry.stop_points[i], render_settings_.stop_label_offset, stops[i]->id, styles.stop_name_font, styles.underlayer);
+            render.AddText(geometry.stop_points[i], render_settings_.stop_label_offset, stops[i]->id, styles.stop_name_font, styles.stop_name);
+        }
+        break;
+    }
+}
+
+size_t MapFragmentCache::GetMemoryUsage() const {
+    size_t bytes = memory::GetHashTableBytes(buses) + memory::GetHashTableBytes(stops);
+    for (const auto& [bus, fragments] : buses) {
+        bytes += memory::GetHeapBytes(fragments.route) + memory::GetHeapBytes(fragments.labels);
+    }
+    for (const auto& [stop, fragments] : stops) {
+        bytes += memory::GetHeapBytes(fragments.circle) + memory::GetHeapBytes(fragments.label);
+    }
+    return bytes;
+}
+
+size_t MapGeometry::GetMemoryUsage() const {
+    return (index ? index->GetMemoryUsage() : 0) + memory::GetHeapBytes(stop_points) + route_detail.capacity() / 8
+         + (labels.bus_labels.capacity() + labels.stop_labels.capacity()) / 8;
+}
+
+std::optional<int> MapRenderer::GetDetailLevel(const GeoBounds& bounds, double width, double height) const {
+    if (render_settings_.simplification_tolerance <= 0.0 || bounds.IsEmpty()) {
+        return std::nullopt;
+    }
+    const std::array<geo::Coordinates, 2> corners{bounds.south_west, bounds.north_east};
+    const double zoom = SphereProjector(corners.begin(), corners.end(), width, height, 0.0).GetZoom();
+    if (IsZero(zoom)) {
+        return std::nullopt;
+    }
+    return static_cast<int>(std::ceil(std::log2(zoom)));
+}
+
+LabelPlacement MapRenderer::PlaceViewportLabels(const MapIndex& index, const GeoBounds& bounds,
+                                               double width, double height) const {
+    const std::array<geo::Coordinates, 2> corners{bounds.south_west, bounds.north_east};
+    const double zoom = SphereProjector(corners.begin(), corners.end(), width, height, 0.0).GetZoom();
+    if (!render_settings_.label_culling || bounds.IsEmpty() || IsZero(zoom)) {
+        return {};
+    }
+    // Проекция области - масштаб zoom и сдвиг к её углу. Сдвиг не меняет пересечений подписей,
+    // поэтому точки считаются от угла всей сети
+    const auto& network = index.GetBounds();
+    const auto& stops = index.GetStops();
+    return PlaceLabels(index, [&](uint32_t stop) {
+        return svg::Point{(stops[stop]->coordinates.lng - network.south_west.lng) * zoom,
+                          (network.north_east.lat - stops[stop]->coordinates.lat) * zoom};
+    });
+}
 
+RouteDetail MapRenderer::SimplifyRoutes(const MapIndex& index, int detail_level) const {
+    TC_TRACE_SCOPE("simplify_routes"sv);
+    // Масштаб уровня не меньше масштаба области, поэтому погрешность в пикселях не больше заданной
+    return index.SimplifyRoutes(std::ldexp(render_settings_.simplification_tolerance, -detail_level));
+}
+
+MapRenderer::DocumentStyles MapRenderer::AddDocumentStyles(svg::FlatDocument& render) const {
+    // Оформление общее для всех элементов одного цвета, поэтому создаётся один раз на цвет палитры
+    DocumentStyles styles;
+    styles.underlayer = render.AddStyle({render_settings_.underlayer_color,
+                                         render_settings_.underlayer_color,
+                                         render_settings_.underlayer_width,
+                                         svg::StrokeLineCap::ROUND,
+                                         svg::StrokeLineJoin::ROUND});
+    styles.palette.reserve(std::max<size_t>(render_settings_.color_palette.size(), 1));
+    for (const auto& color : render_settings_.color_palette) {
+        styles.palette.push_back({
+            render.AddStyle({"none"s, color, render_settings_.line_width,
+                             svg::StrokeLineCap::ROUND, svg::StrokeLineJoin::ROUND}),
+            render.AddStyle({color, std::nullopt, std::nullopt, std::nullopt, std::nullopt})});
+    }
+    if (styles.palette.empty()) {
+        // Без палитры маршруты рисуются без цвета
+        styles.palette.push_back({
+            render.AddStyle({"none"s, svg::Color{}, render_settings_.line_width,
+                             svg::StrokeLineCap::ROUND, svg::StrokeLineJoin::ROUND}),
+            render.AddStyle({svg::Color{}, std::nullopt, std::nullopt, std::nullopt, std::nullopt})});
+    }
+    styles.stop_circle = render.AddStyle({"white"s, std::nullopt, std::nullopt, std::nullopt, std::nullopt});
+    styles.stop_name = render.AddStyle({"black"s, std::nullopt, std::nullopt, std::nullopt, std::nullopt});
+    styles.bus_name_font = render.AddFont({render_settings_.bus_label_font_size, "Verdana"s, "bold"s});
+    styles.stop_name_font = render.AddFont({render_settings_.stop_label_font_size, "Verdana"s, std::nullopt});
+    return styles;
+}
+
+MapRenderer::ViewportMargin MapRenderer::GetViewportMargin(const MapIndex& index) const {
+    // Подпись начинается у точки остановки со смещением, занимает по высоте около размера шрифта
+    // и тянется вправо на ширину текста: точка подписи левее области на ширину самой длинной
+    // подписи (по той же оценке ширины символов, что и при отборе подписей) ещё может задеть область
+    const auto& s = render_settings_;
+    const double line = std::max(s.line_width / 2.0, s.stop_radius);
+    const double label = std::max({std::abs(s.bus_label_offset.x), std::abs(s.bus_label_offset.y),
+                                   std::abs(s.stop_label_offset.x), std::abs(s.stop_label_offset.y)})
+                       + std::max(s.bus_label_font_size, s.stop_label_font_size)
+                       + s.underlayer_width;
+    const double text_width = std::max(
+        static_cast<double>(index.GetMaxBusNameLength()) * s.bus_label_font_size * BOLD_LABEL_CHAR_WIDTH,
+        static_cast<double>(index.GetMaxStopNameLength()) * s.stop_label_font_size * LABEL_CHAR_WIDTH);
+    return {std::max(line, label), text_width};
+}
+
+}  // namespace renderer
@@ -2,9 +2,15 @@
 
 #include "domain.h"
 #include "geo.h"
+#include "map_index.h"
+#include "raster.h"
 #include "svg.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -21,6 +27,8 @@ inline bool IsZero(double value) {
 
 class SphereProjector {
 public:
+    SphereProjector() = default;
+
     // points_begin и points_end задают начало и конец интервала элементов geo::Coordinates
     template <typename PointInputIt>
     SphereProjector(PointInputIt points_begin, PointInputIt points_end,
@@ -71,6 +79,11 @@ public:
         }
     }
 
+    // Число пикселей на градус
+    double GetZoom() const {
+        return zoom_coeff_;
+    }
+
     // Проецирует широту и долготу в координаты внутри SVG-изображения
     svg::Point operator()(geo::Coordinates coords) const {
         return {
@@ -79,20 +92,80 @@ public:
         };
     }
 
+    bool operator==(const SphereProjector& other) const = default;
+
 private:
-    double padding_;
+    double padding_ = 0;
     double min_lon_ = 0;
     double max_lat_ = 0;
     double zoom_coeff_ = 0;
 };
 
-struct StopCmp {
-    using StopPtr = const transport::Stop*;
-    bool operator()(StopPtr lhs, StopPtr rhs) const {
-        return lhs->id < rhs->id;
+// Подписи, оставшиеся после отбора пересекающихся: флаги для подписей маршрутов
+// MapIndex::GetBusLabels() и остановок MapIndex::GetStops(). Пустые - выводятся все подписи
+struct LabelPlacement {
+    std::vector<bool> bus_labels;
+    std::vector<bool> stop_labels;
+
+    bool IsBusLabelVisible(size_t i) const {
+        return bus_labels.empty() || bus_labels[i];
+    }
+    bool IsStopLabelVisible(size_t i) const {
+        return stop_labels.empty() || stop_labels[i];
     }
 };
 
+// Карта, подготовленная к рендеру: маршруты и остановки индекса и точки остановок на полной карте.
+// Строится один раз после наполнения каталога и загрузки настроек рендера и используется всеми рендерами
+struct MapGeometry {
+    std::shared_ptr<const MapIndex> index;
+    SphereProjector projector;
+    // Точка остановки index->GetStops()[i] на изображении
+    std::vector<svg::Point> stop_points;
+    // Вершины ломаных маршрутов после упрощения (пустой, если упрощение выключено)
+    RouteDetail route_detail;
+    // Подписи index->GetBusLabels() и index->GetStops(), оставленные на карте
+    LabelPlacement labels;
+    // Суммарная длина всех подписей карты
+    size_t text_size = 0;
+
+    size_t GetMemoryUsage() const;
+};
+
+/*
+ * Готовые фрагменты SVG текста карты между её рендерами: ломаная и подписи каждого маршрута,
+ * точка и подпись каждой остановки. Остановки и маршруты каталога не меняются после добавления,
+ * поэтому фрагмент маршрута определяется маршрутом и номером цвета палитры (он сдвигается,
+ * когда перед маршрутом по названию добавляется другой), фрагмент остановки - остановкой.
+ * При отборе подписей фрагмент зависит ещё и от того, какие из его подписей остались на карте.
+ * При смене проекции или настроек рендера все фрагменты сбрасываются
+ */
+struct MapFragmentCache {
+    struct BusFragments {
+        size_t palette_index = 0;
+        std::string route;
+        std::string labels;
+        std::vector<bool> visible_labels;
+        // Номер рендера, в котором фрагменты использовались последний раз
+        uint64_t generation = 0;
+    };
+    struct StopFragments {
+        std::string circle;
+        std::string label;
+        bool is_label_visible = true;
+        uint64_t generation = 0;
+    };
+
+    std::unordered_map<MapIndex::BusPtr, BusFragments> buses;
+    std::unordered_map<MapIndex::StopPtr, StopFragments> stops;
+    // Проекция и версия настроек рендера, по которым построены фрагменты
+    SphereProjector projector;
+    uint64_t renderer_version = 0;
+    uint64_t generation = 0;
+
+    size_t GetMemoryUsage() const;
+};
+
 class MapRenderer {
 public:
     struct RenderSettings {
@@ -108,6 +181,16 @@ public:
         svg::Color underlayer_color;
         double underlayer_width = 0.0;
         std::vector<svg::Color> color_palette;
+        // Допуск упрощения ломаных маршрутов в пикселях: вершины, которые отклоняют ломаную
+        // меньше чем на допуск, не выводятся. 0 - выводить все вершины
+        double simplification_tolerance = 0.0;
+        // Компактный SVG (svg::FlatDocument::RenderCompact) с координатами, округлёнными
+        // до svg_precision знаков после запятой
+        bool compact_svg = false;
+        int svg_precision = 2;
+        // Отбор подписей: подпись не выводится, если её приблизительный прямоугольник пересекает
+        // подпись важнее (подписи маршрутов, затем остановок по убыванию числа заездов маршрутов)
+        bool label_culling = false;
     };
 
 public:
@@ -116,16 +199,109 @@ public:
 
     void SetRenderSettings(RenderSettings render_settings);
 
+    // Номер версии настроек: увеличивается при каждой их смене
+    uint64_t GetVersion() const;
+
     svg::Color GetBusColor(int bus_index);
     
+    // Проецирует остановки индекса на изображение по настройкам рендера
+    MapGeometry ProjectStops(std::shared_ptr<const MapIndex> index) const;
+
     // Рендерит транспортный каталог
-    using BusPtr = const transport::Bus*;
-    using StopPtr = const transport::Stop*;
-    svg::Document RenderMap(std::vector<BusPtr>&& buses, 
-                            std::unordered_set<BusPtr>&& roundtrip_buses) const;
+    svg::FlatDocument RenderMap(const MapGeometry& geometry) const;
+
+    // Дописывает SVG текст карты в конец строки. При числе потоков больше одного ломаные, подписи
+    // и остановки рендерятся кусками параллельно и склеиваются в том же порядке, поэтому
+    // текст совпадает с однопоточным байт в байт. Компактный SVG рендерится в одном потоке
+    void RenderMap(const MapGeometry& geometry, std::string& svg) const;
+
+    // То же, что RenderMap(geometry, svg), но рендерит только элементы, которых нет в cache,
+    // и склеивает карту из фрагментов. Текст совпадает с полным рендером байт в байт.
+    // Компактный SVG из фрагментов не собирается и рендерится целиком
+    void RenderMap(const MapGeometry& geometry, MapFragmentCache& cache, std::string& svg) const;
+
+    // Растровое изображение карты размером width x height из настроек рендера
+    // (полосы изображения рисуются в потоках рендера)
+    raster::Image RasterizeMap(const MapGeometry& geometry) const;
+
+    // Дописывает текст документа в конец строки: обычный или компактный, как задано в настройках
+    void RenderSvg(const svg::FlatDocument& document, std::string& svg) const;
+
+    // Число потоков рендера карты в текст (по умолчанию один)
+    void SetThreadCount(size_t thread_count);
+
+    // Рендерит область bounds карты в изображение width x height (без полей) с тем же
+    // оформлением, что и полная карта. Выводятся только элементы, попавшие в область
+    // (с запасом на толщину линий и подписи), ломаные обрезаются по её границе
+    // Вершины, не вошедшие в route_detail, пропускаются (кроме концов видимых частей ломаных)
+    // Выводятся подписи, оставленные в network_labels - результате PlaceViewportLabels для области
+    // того же масштаба; без него отбор по всей сети выполняется заново
+    svg::FlatDocument RenderViewport(const MapIndex& index, const GeoBounds& bounds,
+                                     double width, double height,
+                                     const RouteDetail* route_detail = nullptr,
+                                     const LabelPlacement* network_labels = nullptr) const;
+
+    // Отбирает подписи всей сети в масштабе области bounds размером width x height.
+    // Области одного масштаба (тайлы одного уровня) отличаются от сети только сдвигом, поэтому
+    // отбор у них общий и подпись на стыке двух областей либо видна в обеих, либо скрыта.
+    // Пустой результат (все подписи видны), если отбор подписей выключен
+    LabelPlacement PlaceViewportLabels(const MapIndex& index, const GeoBounds& bounds,
+                                       double width, double height) const;
+
+    // Уровень детализации ломаных для области: ceil(log2(пикселей на градус)).
+    // nullopt, если упрощение выключено или область вырождена
+    std::optional<int> GetDetailLevel(const GeoBounds& bounds, double width, double height) const;
+
+    // Упрощает ломаные маршрутов с допуском simplification_tolerance на уровне детализации detail_level
+    RouteDetail SimplifyRoutes(const MapIndex& index, int detail_level) const;
 
 private:
+    // Слои карты в порядке вывода
+    enum class MapLayer {
+        ROUTES,
+        BUS_LABELS,
+        STOPS,
+        STOP_LABELS,
+    };
+
+    static size_t GetItemCount(const MapIndex& index, MapLayer layer);
+
+    // Оформление и шрифты карты, общие для всех её элементов
+    struct DocumentStyles {
+        struct PaletteStyles {
+            svg::FlatDocument::StyleId polyline;
+            svg::FlatDocument::StyleId bus_name;
+        };
+        std::vector<PaletteStyles> palette;
+        svg::FlatDocument::StyleId underlayer;
+        svg::FlatDocument::StyleId stop_circle;
+        svg::FlatDocument::StyleId stop_name;
+        svg::FlatDocument::FontId bus_name_font;
+        svg::FlatDocument::FontId stop_name_font;
+    };
+    DocumentStyles AddDocumentStyles(svg::FlatDocument& render) const;
+
+    // Добавляет элементы слоя с номерами [first, last)
+    void RenderLayer(const MapGeometry& geometry, MapLayer layer, size_t first, size_t last,
+                     const DocumentStyles& styles, svg::FlatDocument& render) const;
+
+    // Отбирает подписи маршрутов и остановок index, которые не пересекаются с более важными.
+    // get_stop_point(i) - точка остановки i на изображении
+    template <typename GetStopPoint>
+    LabelPlacement PlaceLabels(const MapIndex& index, GetStopPoint get_stop_point) const;
+
+    // Запас вокруг области в пикселях: элементы за её границей, которые могут в неё выступать
+    struct ViewportMargin {
+        // Со всех сторон: толщина линий, смещения и высота подписей
+        double around = 0.0;
+        // Дополнительно слева: ширина самой длинной подписи, текст которой тянется вправо
+        double left_extra = 0.0;
+    };
+    ViewportMargin GetViewportMargin(const MapIndex& index) const;
+
     RenderSettings render_settings_;
+    uint64_t version_ = 0;
+    size_t thread_count_ = 1;
 };
 
 }  // namespace renderer
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * Учёт памяти по подсистемам и бюджет памяти для дорогих построений.
+ * Размеры контейнеров оцениваются по их вместимости и типичному устройству узлов
+ * стандартной библиотеки (libstdc++), без учёта служебных данных аллокатора.
+ */
+
+namespace memory {
+
+// Занимаемая память по подсистемам в порядке добавления
+class Report {
+public:
+    void Add(std::string name, size_t bytes) {
+        entries_.emplace_back(std::move(name), bytes);
+    }
+
+    const std::vector<std::pair<std::string, size_t>>& GetEntries() const {
+        return entries_;
+    }
+
+    size_t GetTotal() const {
+        size_t total = 0;
+        for (const auto& [name, bytes] : entries_) {
+            total += bytes;
+        }
+        return total;
+    }
+
+private:
+    std::vector<std::pair<std::string, size_t>> entries_;
+};
+
+// Размер в КиБ с округлением вверх для вывода в JSON: в байтах таблица маршрутов
+// не помещается в int
+inline int ToKibibytes(size_t bytes) {
+    return static_cast<int>(std::min<size_t>((bytes + 1023) / 1024, std::numeric_limits<int>::max()));
+}
+
+// Память строки в куче (короткие строки хранятся внутри объекта)
+inline size_t GetHeapBytes(const std::string& value) {
+    static const size_t sso_capacity = std::string().capacity();
+    return value.capacity() > sso_capacity ? value.capacity() + 1 : 0;
+}
+
+template <typename T>
+size_t GetHeapBytes(const std::vector<T>& values) {
+    return values.capacity() * sizeof(T);
+}
+
+// Элементы deque лежат в блоках по 512 байт плюс карта указателей на блоки
+template <typename T>
+size_t GetHeapBytes(const std::deque<T>& values) {
+    constexpr size_t block_size = sizeof(T) < 512 ? 512 / sizeof(T) : 1;
+    const size_t block_count = values.size() / block_size + 1;
+    return block_count * (block_size * sizeof(T) + sizeof(T*));
+}
+
+// Узел хеш-таблицы: указатель на следующий узел, значение и сохранённый хеш
+template <typename HashTable>
+size_t GetHashTableBytes(const HashTable& table) {
+    return table.bucket_count() * sizeof(void*)
+           + table.size() * (sizeof(void*) + sizeof(typename HashTable::value_type) + sizeof(size_t));
+}
+
+// Узел красно-чёрного дерева: цвет, три указателя и значение
+template <typename Tree>
+size_t GetTreeBytes(const Tree& tree) {
+    return tree.size() * (4 * sizeof(void*) + sizeof(typename Tree::value_type));
+}
+
+// Бюджет памяти превышен при политике FAIL
+class BudgetExceededError : public std::runtime_error {
+public:
+    using runtime_error::runtime_error;
+};
+
+// Ограничение памяти для структур, размер которых известен до построения
+struct Budget {
+    enum class Policy {
+        FAIL,      // бросить BudgetExceededError
+        FALLBACK   // построить более дешёвый вариант структуры
+    };
+
+    size_t limit_bytes = std::numeric_limits<size_t>::max();
+    Policy policy = Policy::FALLBACK;
+
+    // Возвращает true, если структура укладывается в бюджет; при политике FAIL
+    // вместо false бросает BudgetExceededError
+    bool Allows(std::string_view subsystem, size_t bytes) const {
+        if (bytes <= limit_bytes) {
+            return true;
+        }
+        if (policy == Policy::FAIL) {
+            throw BudgetExceededError("memory budget exceeded: " + std::string(subsystem) + " needs "
+                                      + std::to_string(bytes) + " bytes, budget is "
+                                      + std::to_string(limit_bytes) + " bytes");
+        }
+        return false;
+    }
+};
+
+}  // namespace memory
@@ -0,0 +1,296 @@
+#include "png.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <vector>
+
+using namespace std::literals;
+
+namespace raster {
+
+namespace {
+
+// ---------- Контрольные суммы ------------------
+
+constexpr std::array<uint32_t, 256> MakeCrcTable() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < table.size(); ++i) {
+        uint32_t value = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+        }
+        table[i] = value;
+    }
+    return table;
+}
+
+constexpr std::array<uint32_t, 256> CRC_TABLE = MakeCrcTable();
+
+uint32_t UpdateCrc(uint32_t crc, std::string_view data) {
+    for (char byte : data) {
+        crc = CRC_TABLE[(crc ^ static_cast<uint8_t>(byte)) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+uint32_t Adler32(const std::vector<uint8_t>& data) {
+    constexpr uint32_t modulo = 65521;
+    // 5552 - наибольшее число байт, после которого суммы ещё не переполняют uint32_t
+    constexpr size_t block_size = 5552;
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (size_t first = 0; first < data.size(); first += block_size) {
+        const size_t last = std::min(data.size(), first + block_size);
+        for (size_t i = first; i < last; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= modulo;
+        b %= modulo;
+    }
+    return (b << 16) | a;
+}
+
+// ---------- Deflate ------------------
+
+// Запись битов младшим битом вперёд, как требует deflate
+class BitWriter {
+public:
+    explicit BitWriter(std::string& out)
+        : out_(out)
+    {}
+
+    void Write(uint32_t bits, int count) {
+        buffer_ |= static_cast<uint64_t>(bits) << buffered_;
+        buffered_ += count;
+        while (buffered_ >= 8) {
+            out_.push_back(static_cast<char>(buffer_ & 0xFF));
+            buffer_ >>= 8;
+            buffered_ -= 8;
+        }
+    }
+
+    // Коды Хаффмана записываются старшим битом вперёд
+    void WriteCode(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; ++i) {
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        Write(reversed, length);
+    }
+
+    void Flush() {
+        if (buffered_ > 0) {
+            out_.push_back(static_cast<char>(buffer_ & 0xFF));
+        }
+        buffer_ = 0;
+        buffered_ = 0;
+    }
+
+private:
+    std::string& out_;
+    uint64_t buffer_ = 0;
+    int buffered_ = 0;
+};
+
+// Фиксированный код Хаффмана символа литералов и длин (RFC 1951, 3.2.6)
+void WriteLiteralCode(BitWriter& writer, uint32_t symbol) {
+    if (symbol < 144) {
+        writer.WriteCode(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        writer.WriteCode(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        writer.WriteCode(symbol - 256, 7);
+    } else {
+        writer.WriteCode(0xC0 + symbol - 280, 8);
+    }
+}
+
+constexpr std::array<uint16_t, 29> LENGTH_BASES{
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr std::array<uint8_t, 29> LENGTH_EXTRA_BITS{
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr std::array<uint16_t, 30> DISTANCE_BASES{
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr std::array<uint8_t, 30> DISTANCE_EXTRA_BITS{
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+void WriteMatch(BitWriter& writer, uint32_t length, uint32_t distance) {
+    const size_t length_code = std::upper_bound(LENGTH_BASES.begin(), LENGTH_BASES.end(), length) - LENGTH_BASES.begin() - 1;
+    WriteLiteralCode(writer, 257 + static_cast<uint32_t>(length_code));
+    writer.Write(length - LENGTH_BASES[length_code], LENGTH_EXTRA_BITS[length_code]);
+
+    const size_t distance_code = std::upper_bound(DISTANCE_BASES.begin(), DISTANCE_BASES.end(), distance) - DISTANCE_BASES.begin() - 1;
+    writer.WriteCode(static_cast<uint32_t>(distance_code), 5);
+    writer.Write(distance - DISTANCE_BASES[distance_code], DISTANCE_EXTRA_BITS[distance_code]);
+}
+
+constexpr size_t WINDOW_SIZE = 32768;
+constexpr size_t MIN_MATCH = 3;
+constexpr size_t MAX_MATCH = 258;
+constexpr int HASH_BITS = 15;
+// Сколько предыдущих вхождений хеша проверяется при поиске совпадения
+constexpr int MAX_CHAIN_LENGTH = 32;
+
+uint32_t HashAt(const std::vector<uint8_t>& data, size_t pos) {
+    const uint32_t value = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16);
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Сжимает данные одним блоком deflate с фиксированными кодами: совпадения ищутся
+// по цепочкам позиций с одинаковым хешем трёх байт в окне 32 КиБ
+void Deflate(const std::vector<uint8_t>& data, std::string& out) {
+    BitWriter writer(out);
+    // BFINAL = 1, BTYPE = 01 (фиксированные коды)
+    writer.Write(1, 1);
+    writer.Write(1, 2);
+
+    std::vector<int32_t> head(size_t{1} << HASH_BITS, -1);
+    std::vector<int32_t> previous(WINDOW_SIZE, -1);
+    auto insert = [&](size_t pos) {
+        if (pos + MIN_MATCH <= data.size()) {
+            const uint32_t hash = HashAt(data, pos);
+            previous[pos % WINDOW_SIZE] = head[hash];
+            head[hash] = static_cast<int32_t>(pos);
+        }
+    };
+
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t best_length = 0;
+        size_t best_distance = 0;
+        if (pos + MIN_MATCH <= data.size()) {
+            const size_t max_length = std::min(MAX_MATCH, data.size() - pos);
+            int32_t candidate = head[HashAt(data, pos)];
+            for (int chain = 0; candidate >= 0 && chain < MAX_CHAIN_LENGTH; ++chain) {
+                const size_t distance = pos - static_cast<size_t>(candidate);
+                if (distance > WINDOW_SIZE) {
+                    break;
+                }
+                size_t length = 0;
+                while (length < max_length && data[candidate + length] == data[pos + length]) {
+                    ++length;
+                }
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = distance;
+                    if (length == max_length) {
+                        break;
+                    }
+                }
+                candidate = previous[candidate % WINDOW_SIZE];
+            }
+        }
+
+        if (best_length >= MIN_MATCH) {
+            WriteMatch(writer, static_cast<uint32_t>(best_length), static_cast<uint32_t>(best_distance));
+            for (size_t end = pos + best_length; pos < end; ++pos) {
+                insert(pos);
+            }
+        } else {
+            WriteLiteralCode(writer, data[pos]);
+            insert(pos);
+            ++pos;
+        }
+    }
+    // Конец блока
+    WriteLiteralCode(writer, 256);
+    writer.Flush();
+}
+
+// ---------- Фильтры строк PNG ------------------
+
+uint8_t PaethPredictor(uint8_t left, uint8_t up, uint8_t up_left) {
+    const int estimate = left + up - up_left;
+    const int left_distance = std::abs(estimate - left);
+    const int up_distance = std::abs(estimate - up);
+    const int up_left_distance = std::abs(estimate - up_left);
+    if (left_distance <= up_distance && left_distance <= up_left_distance) {
+        return left;
+    }
+    return up_distance <= up_left_distance ? up : up_left;
+}
+
+// Строки с байтом типа фильтра перед каждой: для строки выбирается фильтр
+// с наименьшей суммой модулей байтов как знаковых чисел
+std::vector<uint8_t> FilterRows(const Image& image) {
+    constexpr size_t pixel_size = 4;
+    const size_t row_size = static_cast<size_t>(image.width) * pixel_size;
+    std::vector<uint8_t> filtered;
+    filtered.reserve((row_size + 1) * image.height);
+
+    const std::vector<uint8_t> zero_row(row_size, 0);
+    std::array<std::vector<uint8_t>, 5> candidates;
+    for (auto& candidate : candidates) {
+        candidate.resize(row_size);
+    }
+    for (size_t y = 0; y < image.height; ++y) {
+        const uint8_t* row = image.pixels.data() + y * row_size;
+        const uint8_t* up = y > 0 ? row - row_size : zero_row.data();
+        for (size_t i = 0; i < row_size; ++i) {
+            const uint8_t left = i >= pixel_size ? row[i - pixel_size] : 0;
+            const uint8_t up_left = i >= pixel_size ? up[i - pixel_size] : 0;
+            candidates[0][i] = row[i];
+            candidates[1][i] = static_cast<uint8_t>(row[i] - left);
+            candidates[2][i] = static_cast<uint8_t>(row[i] - up[i]);
+            candidates[3][i] = static_cast<uint8_t>(row[i] - (left + up[i]) / 2);
+            candidates[4][i] = static_cast<uint8_t>(row[i] - PaethPredictor(left, up[i], up_left));
+        }
+        size_t best_filter = 0;
+        uint64_t best_sum = UINT64_MAX;
+        for (size_t filter = 0; filter < candidates.size(); ++filter) {
+            uint64_t sum = 0;
+            for (uint8_t byte : candidates[filter]) {
+                sum += static_cast<uint64_t>(std::abs(static_cast<int8_t>(byte)));
+            }
+            if (sum < best_sum) {
+                best_sum = sum;
+                best_filter = filter;
+            }
+        }
+        filtered.push_back(static_cast<uint8_t>(best_filter));
+        filtered.insert(filtered.end(), candidates[best_filter].begin(), candidates[best_filter].end());
+    }
+    return filtered;
+}
+
+void AppendUint32(std::string& out, uint32_t value) {
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+// Блок PNG: длина, тип, данные, CRC типа и данных
+void AppendChunk(std::string& out, std::string_view type, std::string_view data) {
+    AppendUint32(out, static_cast<uint32_t>(data.size()));
+    out.append(type);
+    out.append(data);
+    AppendUint32(out, UpdateCrc(UpdateCrc(0xFFFFFFFFu, type), data) ^ 0xFFFFFFFFu);
+}
+
+}  // namespace
+
+void EncodePng(const Image& image, std::string& out) {
+    out.append("\x89PNG\r\n\x1A\n"sv);
+
+    std::string header;
+    AppendUint32(header, image.width);
+    AppendUint32(header, image.height);
+    // 8 бит на канал, RGBA, сжатие deflate, адаптивные фильтры, без чересстрочности
+    header.append("\x08\x06\x00\x00\x00"sv);
+    AppendChunk(out, "IHDR"sv, header);
+
+    // Поток zlib: заголовок (deflate, окно 32 КиБ), блок deflate, Adler-32 несжатых данных
+    const auto filtered = FilterRows(image);
+    std::string stream = "\x78\x01"s;
+    Deflate(filtered, stream);
+    AppendUint32(stream, Adler32(filtered));
+    AppendChunk(out, "IDAT"sv, stream);
+
+    AppendChunk(out, "IEND"sv, {});
+}
+
+}  // namespace raster
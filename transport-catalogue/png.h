@@ -0,0 +1,18 @@
+#pragma once
+
+#include "raster.h"
+
+#include <string>
+
+/*
+ * Кодирование изображения в PNG без внешних библиотек: фильтр строк выбирается по
+ * наименьшей сумме модулей, поток сжимается встроенным deflate (LZ77 с цепочками хешей
+ * и фиксированными кодами Хаффмана)
+ */
+
+namespace raster {
+
+// Дописывает изображение в формате PNG (RGBA, 8 бит на канал) в конец строки
+void EncodePng(const Image& image, std::string& out);
+
+}  // namespace raster
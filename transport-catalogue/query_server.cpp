@@ -0,0 +1,373 @@
+#include "query_server.h"
+
+#include "json_builder.h"
+#include "json_reader.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// Идентификаторы служебных дескрипторов в epoll, идентификаторы соединений идут с нуля
+constexpr uint64_t LISTEN_EVENT_ID = std::numeric_limits<uint64_t>::max();
+constexpr uint64_t WAKE_EVENT_ID = std::numeric_limits<uint64_t>::max() - 1;
+
+[[noreturn]] void ThrowSystemError(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+void AddToEpoll(int epoll_fd, int fd, uint32_t events, uint64_t id) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = id;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        ThrowSystemError("QueryServer: epoll_ctl add failed");
+    }
+}
+
+}  // namespace
+
+QueryServer::QueryServer(const RequestHandler& request_handler, std::string socket_path, size_t worker_count)
+    : request_handler_(request_handler)
+    , socket_path_(std::move(socket_path))
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path_.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("QueryServer: socket path is too long");
+    }
+    std::memcpy(address.sun_path, socket_path_.c_str(), socket_path_.size() + 1);
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        ThrowSystemError("QueryServer: socket failed");
+    }
+    unlink(socket_path_.c_str());
+    if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0
+        || listen(listen_fd_, SOMAXCONN) < 0) {
+        close(listen_fd_);
+        ThrowSystemError("QueryServer: bind/listen failed");
+    }
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wake_fd_ < 0) {
+        close(listen_fd_);
+        ThrowSystemError("QueryServer: epoll/eventfd failed");
+    }
+    AddToEpoll(epoll_fd_, listen_fd_, EPOLLIN, LISTEN_EVENT_ID);
+    AddToEpoll(epoll_fd_, wake_fd_, EPOLLIN, WAKE_EVENT_ID);
+
+    worker_count = std::max<size_t>(worker_count, 1);
+    workers_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.emplace_back([this]() { WorkerLoop(); });
+    }
+}
+
+QueryServer::~QueryServer() {
+    {
+        std::lock_guard lock(job_mutex_);
+        is_stopping_ = true;
+    }
+    job_ready_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+
+    for (const auto& [id, connection] : connections_) {
+        close(connection.fd);
+    }
+    close(wake_fd_);
+    close(epoll_fd_);
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+}
+
+void QueryServer::Stop() {
+    // Только атомарная запись и write: безопасно в обработчике сигнала
+    is_stop_requested_ = true;
+    const uint64_t value = 1;
+    [[maybe_unused]] auto written = write(wake_fd_, &value, sizeof(value));
+}
+
+void QueryServer::Run() {
+    std::array<epoll_event, 64> events;
+    while (!is_stop_requested_) {
+        const int event_count = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), -1);
+        if (event_count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("QueryServer: epoll_wait failed");
+        }
+
+        for (int i = 0; i < event_count; ++i) {
+            const uint64_t id = events[i].data.u64;
+            if (id == LISTEN_EVENT_ID) {
+                AcceptConnections();
+                continue;
+            }
+            if (id == WAKE_EVENT_ID) {
+                uint64_t value;
+                [[maybe_unused]] auto read_size = read(wake_fd_, &value, sizeof(value));
+                TakeCompletions();
+                continue;
+            }
+
+            auto it = connections_.find(id);
+            if (it == connections_.end()) {
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                CloseConnection(id);
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                ReadConnection(it->second);
+            }
+            if (events[i].events & EPOLLOUT) {
+                WriteConnection(it->second);
+            }
+            CloseIfDone(id);
+        }
+    }
+}
+
+void QueryServer::WorkerLoop() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock lock(job_mutex_);
+            job_ready_.wait(lock, [this]() { return is_stopping_ || !jobs_.empty(); });
+            if (is_stopping_) {
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        std::ostringstream response;
+        transport::PrintStatRequestLine(request_handler_, job.line, response);
+        response << '\n';
+
+        {
+            std::lock_guard lock(completion_mutex_);
+            completions_.push_back({job.connection_id, job.sequence, std::move(response).str()});
+        }
+        const uint64_t value = 1;
+        [[maybe_unused]] auto written = write(wake_fd_, &value, sizeof(value));
+    }
+}
+
+void QueryServer::AcceptConnections() {
+    for (;;) {
+        const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // EAGAIN: все ожидающие соединения приняты; прочие ошибки касаются одного клиента
+            return;
+        }
+        const uint64_t id = next_connection_id_++;
+        auto& connection = connections_[id];
+        connection.id = id;
+        connection.fd = fd;
+        AddToEpoll(epoll_fd_, fd, EPOLLIN | EPOLLRDHUP, id);
+    }
+}
+
+void QueryServer::ReadConnection(Connection& connection) {
+    std::array<char, 1 << 16> buffer;
+    std::vector<Job> new_jobs;
+    while (!connection.is_input_closed && !IsReadPaused(connection)) {
+        const ssize_t size = read(connection.fd, buffer.data(), buffer.size());
+        if (size > 0) {
+            connection.input.append(buffer.data(), static_cast<size_t>(size));
+            TakeRequestLines(connection, new_jobs);
+            continue;
+        }
+        if (size == 0) {
+            connection.is_input_closed = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            connection.is_input_closed = true;
+        }
+        break;
+    }
+    // Приостановленное или законченное чтение снимается с epoll
+    WatchEvents(connection, connection.is_write_watched);
+
+    if (!new_jobs.empty()) {
+        {
+            std::lock_guard lock(job_mutex_);
+            jobs_.insert(jobs_.end(),
+                         std::make_move_iterator(new_jobs.begin()),
+                         std::make_move_iterator(new_jobs.end()));
+        }
+        job_ready_.notify_all();
+    }
+}
+
+void QueryServer::TakeRequestLines(Connection& connection, std::vector<Job>& new_jobs) {
+    // Отдаём пулу все полные строки, неполную оставляем до следующего чтения
+    size_t line_begin = 0;
+    for (size_t line_end = connection.input.find('\n');
+         line_end != std::string::npos;
+         line_begin = line_end + 1, line_end = connection.input.find('\n', line_begin)) {
+        std::string line = connection.input.substr(line_begin, line_end - line_begin);
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        new_jobs.push_back({connection.id, connection.next_request_sequence++, std::move(line)});
+    }
+    connection.input.erase(0, line_begin);
+
+    if (connection.input.size() > MAX_REQUEST_LINE_SIZE) {
+        // Клиент не присылает конец строки: отвечаем ошибкой после ответов на предыдущие
+        // запросы и больше не читаем, соединение закроется после отправки
+        std::ostringstream response;
+        json::Builder{}.StartDict()
+                           .Key("error_message").Value(std::string("request line exceeds ") + std::to_string(MAX_REQUEST_LINE_SIZE) + " bytes")
+                       .EndDict()
+                       .Build().Print(response);
+        response << '\n';
+        connection.input.clear();
+        connection.input.shrink_to_fit();
+        connection.is_input_closed = true;
+        connection.ready_responses.emplace(connection.next_request_sequence++, std::move(response).str());
+        FlushReadyResponses(connection);
+    }
+}
+
+void QueryServer::WriteConnection(Connection& connection) {
+    while (connection.output_offset < connection.output.size()) {
+        const ssize_t size = send(connection.fd,
+                                  connection.output.data() + connection.output_offset,
+                                  connection.output.size() - connection.output_offset,
+                                  MSG_NOSIGNAL);
+        if (size > 0) {
+            connection.output_offset += static_cast<size_t>(size);
+            continue;
+        }
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Сокет заполнен: допишем, когда epoll сообщит о готовности
+            WatchEvents(connection, true);
+            return;
+        }
+        // Клиент пропал: ответы отправлять некому
+        connection.is_input_closed = true;
+        connection.output.clear();
+        connection.output_offset = 0;
+        connection.ready_responses.clear();
+        connection.next_response_sequence = connection.next_request_sequence;
+        return;
+    }
+    connection.output.clear();
+    connection.output_offset = 0;
+    WatchEvents(connection, false);
+}
+
+void QueryServer::TakeCompletions() {
+    std::vector<Completion> completions;
+    {
+        std::lock_guard lock(completion_mutex_);
+        completions.swap(completions_);
+    }
+
+    for (auto& completion : completions) {
+        auto it = connections_.find(completion.connection_id);
+        if (it == connections_.end()) {
+            // Соединение уже закрыто
+            continue;
+        }
+        auto& connection = it->second;
+        connection.ready_responses.emplace(completion.sequence, std::move(completion.response));
+        FlushReadyResponses(connection);
+        CloseIfDone(completion.connection_id);
+    }
+}
+
+void QueryServer::FlushReadyResponses(Connection& connection) {
+    // Ответы уходят клиенту строго в порядке его запросов
+    for (auto ready = connection.ready_responses.begin();
+         ready != connection.ready_responses.end() && ready->first == connection.next_response_sequence;
+         ready = connection.ready_responses.erase(ready)) {
+        connection.output += ready->second;
+        ++connection.next_response_sequence;
+    }
+    if (!connection.is_write_watched) {
+        WriteConnection(connection);
+    } else {
+        // Выполненные запросы могли снять приостановку чтения
+        WatchEvents(connection, true);
+    }
+}
+
+void QueryServer::CloseIfDone(uint64_t connection_id) {
+    auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+        return;
+    }
+    const auto& connection = it->second;
+    if (connection.is_input_closed
+        && connection.next_response_sequence == connection.next_request_sequence
+        && connection.output.empty()) {
+        CloseConnection(connection_id);
+    }
+}
+
+void QueryServer::CloseConnection(uint64_t connection_id) {
+    auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+        return;
+    }
+    // Закрытие дескриптора удаляет его из epoll
+    close(it->second.fd);
+    connections_.erase(it);
+
+    // Ещё не взятые пулом запросы соединения выполнять незачем
+    std::lock_guard lock(job_mutex_);
+    std::erase_if(jobs_, [connection_id](const Job& job) { return job.connection_id == connection_id; });
+}
+
+bool QueryServer::IsReadPaused(const Connection& connection) {
+    return connection.output.size() - connection.output_offset > OUTPUT_HIGH_WATER_MARK
+        || connection.next_request_sequence - connection.next_response_sequence >= MAX_PENDING_REQUESTS;
+}
+
+void QueryServer::WatchEvents(Connection& connection, bool is_write_watched) {
+    // Закрытый на чтение сокет всегда готов к чтению: перестаём его слушать, чтобы не крутить цикл впустую.
+    // Приостановленное чтение возобновится по уровню, когда сокет снова начнут слушать
+    const bool is_read_watched = !connection.is_input_closed && !IsReadPaused(connection);
+    if (connection.is_write_watched == is_write_watched && connection.is_read_watched == is_read_watched) {
+        return;
+    }
+    epoll_event event{};
+    event.events = (is_read_watched ? EPOLLIN | EPOLLRDHUP : 0u) | (is_write_watched ? EPOLLOUT : 0u);
+    event.data.u64 = connection.id;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event) < 0) {
+        ThrowSystemError("QueryServer: epoll_ctl mod failed");
+    }
+    connection.is_write_watched = is_write_watched;
+    connection.is_read_watched = is_read_watched;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "request_handler.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Сервер запросов статистики на Unix domain socket (только Linux: epoll, eventfd).
+ * Клиент присылает запросы в формате NDJSON (по одному JSON запросу stat_requests в строке)
+ * и получает строки ответов в том же порядке.
+ *
+ * Поток цикла событий только принимает соединения, читает и пишет сокеты,
+ * запросы выполняет фиксированный пул потоков над общим RequestHandler.
+ *
+ * Память соединения ограничена: строка запроса длиннее MAX_REQUEST_LINE_SIZE получает ответ
+ * с ошибкой, после чего соединение закрывается; чтение соединения приостанавливается, пока
+ * клиент не заберёт ответы сверх OUTPUT_HIGH_WATER_MARK или пул не выполнит его запросы
+ * сверх MAX_PENDING_REQUESTS.
+ */
+
+class QueryServer {
+public:
+    QueryServer(const RequestHandler& request_handler, std::string socket_path, size_t worker_count);
+    ~QueryServer();
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    // Обслуживает клиентов, пока не будет вызван Stop
+    void Run();
+
+    // Просит цикл событий завершиться; можно вызывать из другого потока и из обработчика сигнала
+    void Stop();
+
+    static constexpr size_t MAX_REQUEST_LINE_SIZE = 1 << 20;
+    static constexpr size_t OUTPUT_HIGH_WATER_MARK = 4 << 20;
+    static constexpr uint64_t MAX_PENDING_REQUESTS = 256;
+
+private:
+    // Строка запроса, ожидающая выполнения в пуле
+    struct Job {
+        uint64_t connection_id;
+        uint64_t sequence;
+        std::string line;
+    };
+
+    // Готовый ответ, который цикл событий должен отправить клиенту
+    struct Completion {
+        uint64_t connection_id;
+        uint64_t sequence;
+        std::string response;
+    };
+
+    struct Connection {
+        uint64_t id = 0;
+        int fd = -1;
+        std::string input;
+        std::string output;
+        size_t output_offset = 0;
+        uint64_t next_request_sequence = 0;
+        uint64_t next_response_sequence = 0;
+        // Ответы, готовые раньше предыдущих запросов этого же соединения
+        std::map<uint64_t, std::string> ready_responses;
+        bool is_input_closed = false;
+        bool is_read_watched = true;
+        bool is_write_watched = false;
+    };
+
+    void WorkerLoop();
+
+    void AcceptConnections();
+    void ReadConnection(Connection& connection);
+    // Переносит полные строки входного буфера в new_jobs; слишком длинную неполную строку отвергает
+    void TakeRequestLines(Connection& connection, std::vector<Job>& new_jobs);
+    // Переносит в буфер вывода ответы, очередь которых подошла, и начинает их отправку
+    void FlushReadyResponses(Connection& connection);
+    void WriteConnection(Connection& connection);
+    void TakeCompletions();
+    // Закрывает соединение, если клиент закончил передачу и все ответы отправлены
+    void CloseIfDone(uint64_t connection_id);
+    void CloseConnection(uint64_t connection_id);
+    // Чтение приостановлено: клиент не забирает ответы или пул не успевает за его запросами
+    static bool IsReadPaused(const Connection& connection);
+    // Обновляет события epoll соединения: чтение, пока клиент передаёт запросы и чтение не
+    // приостановлено, и запись при is_write_watched
+    void WatchEvents(Connection& connection, bool is_write_watched);
+
+    const RequestHandler& request_handler_;
+    std::string socket_path_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+
+    // Очередь запросов для пула потоков
+    std::mutex job_mutex_;
+    std::condition_variable job_ready_;
+    std::deque<Job> jobs_;
+    bool is_stopping_ = false;
+
+    std::atomic<bool> is_stop_requested_{false};
+
+    // Ответы от пула потоков для цикла событий
+    std::mutex completion_mutex_;
+    std::vector<Completion> completions_;
+
+    uint64_t next_connection_id_ = 0;
+    std::unordered_map<uint64_t, Connection> connections_;
+    std::vector<std::thread> workers_;
+};
@@ -0,0 +1,605 @@
+#include "raster.h"
+
+#include "task_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <variant>
+
+using namespace std::literals;
+
+namespace raster {
+
+namespace {
+
+// Цвет, умноженный на альфу, компоненты от 0 до 1
+struct Paint {
+    float red = 0.0f;
+    float green = 0.0f;
+    float blue = 0.0f;
+    float alpha = 0.0f;
+};
+
+Paint MakePaint(uint8_t red, uint8_t green, uint8_t blue, double opacity) {
+    const float alpha = static_cast<float>(std::clamp(opacity, 0.0, 1.0));
+    return {red / 255.0f * alpha, green / 255.0f * alpha, blue / 255.0f * alpha, alpha};
+}
+
+// Названия цветов CSS, которые встречаются в настройках рендера
+struct NamedColor {
+    std::string_view name;
+    uint8_t red = 0;
+    uint8_t green = 0;
+    uint8_t blue = 0;
+};
+constexpr std::array<NamedColor, 25> NAMED_COLORS{{
+    {"aqua"sv, 0, 255, 255}, {"black"sv, 0, 0, 0}, {"blue"sv, 0, 0, 255}, {"brown"sv, 165, 42, 42},
+    {"cyan"sv, 0, 255, 255}, {"fuchsia"sv, 255, 0, 255}, {"gold"sv, 255, 215, 0}, {"gray"sv, 128, 128, 128},
+    {"green"sv, 0, 128, 0}, {"grey"sv, 128, 128, 128}, {"indigo"sv, 75, 0, 130}, {"lime"sv, 0, 255, 0},
+    {"magenta"sv, 255, 0, 255}, {"maroon"sv, 128, 0, 0}, {"navy"sv, 0, 0, 128}, {"olive"sv, 128, 128, 0},
+    {"orange"sv, 255, 165, 0}, {"pink"sv, 255, 192, 203}, {"purple"sv, 128, 0, 128}, {"red"sv, 255, 0, 0},
+    {"silver"sv, 192, 192, 192}, {"teal"sv, 0, 128, 128}, {"violet"sv, 238, 130, 238}, {"white"sv, 255, 255, 255},
+    {"yellow"sv, 255, 255, 0},
+}};
+
+std::optional<int> ParseHexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return std::nullopt;
+}
+
+// Цвет вида #rgb или #rrggbb
+std::optional<Paint> ParseHexColor(std::string_view name) {
+    if (name.empty() || name.front() != '#' || (name.size() != 4 && name.size() != 7)) {
+        return std::nullopt;
+    }
+    const size_t digits = name.size() == 4 ? 1 : 2;
+    std::array<uint8_t, 3> channels{};
+    for (size_t i = 0; i < channels.size(); ++i) {
+        int value = 0;
+        for (size_t j = 0; j < digits; ++j) {
+            const auto digit = ParseHexDigit(name[1 + i * digits + j]);
+            if (!digit) {
+                return std::nullopt;
+            }
+            value = value * 16 + *digit;
+        }
+        channels[i] = static_cast<uint8_t>(digits == 1 ? value * 17 : value);
+    }
+    return MakePaint(channels[0], channels[1], channels[2], 1.0);
+}
+
+// Краска цвета SVG; nullopt - не рисовать. Неизвестные названия рисуются чёрным
+std::optional<Paint> ToPaint(const svg::Color& color) {
+    if (const auto* rgb = std::get_if<svg::Rgb>(&color)) {
+        return MakePaint(rgb->red, rgb->green, rgb->blue, 1.0);
+    }
+    if (const auto* rgba = std::get_if<svg::Rgba>(&color)) {
+        return MakePaint(rgba->red, rgba->green, rgba->blue, rgba->opacity);
+    }
+    if (const auto* name = std::get_if<std::string>(&color)) {
+        if (*name == svg::NoneColor || *name == "transparent"sv) {
+            return std::nullopt;
+        }
+        if (const auto hex = ParseHexColor(*name)) {
+            return hex;
+        }
+        for (const auto& named : NAMED_COLORS) {
+            if (named.name == *name) {
+                return MakePaint(named.red, named.green, named.blue, 1.0);
+            }
+        }
+        return MakePaint(0, 0, 0, 1.0);
+    }
+    return std::nullopt;
+}
+
+// По умолчанию в SVG фигуры залиты чёрным и не обведены
+std::optional<Paint> GetFill(const svg::PathStyle& style) {
+    return style.fill_color ? ToPaint(*style.fill_color) : MakePaint(0, 0, 0, 1.0);
+}
+
+std::optional<Paint> GetStroke(const svg::PathStyle& style) {
+    return style.stroke_color ? ToPaint(*style.stroke_color) : std::nullopt;
+}
+
+double GetStrokeHalfWidth(const svg::PathStyle& style) {
+    return style.stroke_width.value_or(1.0) / 2.0;
+}
+
+// ---------- Шрифт ------------------
+
+// Моноширинный шрифт 5x7 для символов ASCII 32-126: столбцы глифа слева направо, бит 0 - верхняя строка
+using Glyph = std::array<uint8_t, 5>;
+constexpr int GLYPH_HEIGHT = 7;
+// Шаг символа в клетках: глиф и пустой столбец
+constexpr int GLYPH_ADVANCE = 6;
+// font-size соответствует 8 клеткам: 7 строк глифа и межстрочный интервал
+constexpr double FONT_SIZE_CELLS = 8.0;
+
+constexpr std::array<Glyph, 95> FONT_5X7{{
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00},
+    {0x14, 0x7F, 0x14, 0x7F, 0x14}, {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+    {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, {0x00, 0x1C, 0x22, 0x41, 0x00},
+    {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x14, 0x08, 0x3E, 0x08, 0x14}, {0x08, 0x08, 0x3E, 0x08, 0x08},
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00},
+    {0x20, 0x10, 0x08, 0x04, 0x02}, {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00},
+    {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31}, {0x18, 0x14, 0x12, 0x7F, 0x10},
+    {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x36, 0x36, 0x00, 0x00},
+    {0x00, 0x56, 0x36, 0x00, 0x00}, {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},
+    {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06}, {0x32, 0x49, 0x79, 0x41, 0x3E},
+    {0x7E, 0x11, 0x11, 0x11, 0x7E}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},
+    {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x01, 0x01},
+    {0x3E, 0x41, 0x41, 0x51, 0x32}, {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00},
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41}, {0x7F, 0x40, 0x40, 0x40, 0x40},
+    {0x7F, 0x02, 0x04, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46},
+    {0x46, 0x49, 0x49, 0x49, 0x31}, {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F},
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x7F, 0x20, 0x18, 0x20, 0x7F}, {0x63, 0x14, 0x08, 0x14, 0x63},
+    {0x03, 0x04, 0x78, 0x04, 0x03}, {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00},
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00}, {0x04, 0x02, 0x01, 0x02, 0x04},
+    {0x40, 0x40, 0x40, 0x40, 0x40}, {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},
+    {0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20}, {0x38, 0x44, 0x44, 0x48, 0x7F},
+    {0x38, 0x54, 0x54, 0x54, 0x18}, {0x08, 0x7E, 0x09, 0x01, 0x02}, {0x08, 0x14, 0x54, 0x54, 0x3C},
+    {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00}, {0x20, 0x40, 0x44, 0x3D, 0x00},
+    {0x00, 0x7F, 0x10, 0x28, 0x44}, {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78},
+    {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38}, {0x7C, 0x14, 0x14, 0x14, 0x08},
+    {0x08, 0x14, 0x14, 0x18, 0x7C}, {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+    {0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C}, {0x1C, 0x20, 0x40, 0x20, 0x1C},
+    {0x3C, 0x40, 0x30, 0x40, 0x3C}, {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0C, 0x50, 0x50, 0x50, 0x3C},
+    {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00}, {0x00, 0x00, 0x7F, 0x00, 0x00},
+    {0x00, 0x41, 0x36, 0x08, 0x00}, {0x08, 0x04, 0x08, 0x10, 0x08},
+}};
+
+// Глиф символов, которых нет в шрифте: рамка
+constexpr Glyph MISSING_GLYPH{0x7F, 0x41, 0x41, 0x41, 0x7F};
+
+// Глиф символа UTF-8, который начинается в data[pos]; pos переходит к следующему символу
+const Glyph& NextGlyph(std::string_view data, size_t& pos) {
+    const auto byte = static_cast<unsigned char>(data[pos++]);
+    if (byte < 0x80) {
+        return byte >= 32 && byte <= 126 ? FONT_5X7[byte - 32] : MISSING_GLYPH;
+    }
+    while (pos < data.size() && (static_cast<unsigned char>(data[pos]) & 0xC0) == 0x80) {
+        ++pos;
+    }
+    return MISSING_GLYPH;
+}
+
+size_t CountGlyphs(std::string_view data) {
+    size_t count = 0;
+    for (size_t pos = 0; pos < data.size(); NextGlyph(data, pos)) {
+        ++count;
+    }
+    return count;
+}
+
+// ---------- Фигуры ------------------
+
+struct Box {
+    double min_x = 0.0;
+    double min_y = 0.0;
+    double max_x = 0.0;
+    double max_y = 0.0;
+
+    Box Expanded(double margin) const {
+        return {min_x - margin, min_y - margin, max_x + margin, max_y + margin};
+    }
+};
+
+// Обводка ломаной: объединение капсул радиуса half_width вокруг отрезков
+struct StrokedPolyline {
+    std::span<const svg::Point> points;
+    double half_width = 0.0;
+};
+
+struct FilledDisk {
+    svg::Point center;
+    double radius = 0.0;
+};
+
+struct StrokedCircle {
+    svg::Point center;
+    double radius = 0.0;
+    double half_width = 0.0;
+};
+
+// Текст шрифтом 5x7: клетка глифа - квадрат со стороной scale, базовая линия проходит через origin.
+// half_width = 0 - заливка клеток, иначе их обводка
+struct GlyphText {
+    svg::Point origin;
+    double scale = 0.0;
+    std::string_view data;
+    double half_width = 0.0;
+};
+
+struct Shape {
+    std::variant<StrokedPolyline, FilledDisk, StrokedCircle, GlyphText> geometry;
+    Paint paint;
+    // Пиксели, которые может задеть фигура, с учётом сглаживания
+    Box box;
+};
+
+// Фигуры элемента в порядке рисования SVG: заливка, затем обводка
+void AddShapes(const svg::FlatDocument::CircleView& circle, std::vector<Shape>& shapes) {
+    const Box box{circle.center.x - circle.radius, circle.center.y - circle.radius,
+                  circle.center.x + circle.radius, circle.center.y + circle.radius};
+    if (const auto fill = GetFill(circle.style)) {
+        shapes.push_back({FilledDisk{circle.center, circle.radius}, *fill, box.Expanded(1.0)});
+    }
+    if (const auto stroke = GetStroke(circle.style)) {
+        const double half_width = GetStrokeHalfWidth(circle.style);
+        shapes.push_back({StrokedCircle{circle.center, circle.radius, half_width}, *stroke, box.Expanded(half_width + 1.0)});
+    }
+}
+
+void AddShapes(const svg::FlatDocument::PolylineView& polyline, std::vector<Shape>& shapes) {
+    const auto stroke = GetStroke(polyline.style);
+    // Ломаная из одной точки в SVG не видна
+    if (!stroke || polyline.points.size() < 2) {
+        return;
+    }
+    Box box{polyline.points[0].x, polyline.points[0].y, polyline.points[0].x, polyline.points[0].y};
+    for (const auto& point : polyline.points) {
+        box.min_x = std::min(box.min_x, point.x);
+        box.min_y = std::min(box.min_y, point.y);
+        box.max_x = std::max(box.max_x, point.x);
+        box.max_y = std::max(box.max_y, point.y);
+    }
+    const double half_width = GetStrokeHalfWidth(polyline.style);
+    shapes.push_back({StrokedPolyline{polyline.points, half_width}, *stroke, box.Expanded(half_width + 1.0)});
+}
+
+void AddShapes(const svg::FlatDocument::TextView& text, std::vector<Shape>& shapes) {
+    const double scale = text.font.size / FONT_SIZE_CELLS;
+    const svg::Point origin{text.position.x + text.offset.x, text.position.y + text.offset.y};
+    const Box box{origin.x, origin.y - GLYPH_HEIGHT * scale,
+                  origin.x + static_cast<double>(CountGlyphs(text.data) * GLYPH_ADVANCE) * scale, origin.y};
+    if (const auto fill = GetFill(text.style)) {
+        shapes.push_back({GlyphText{origin, scale, text.data, 0.0}, *fill, box.Expanded(1.0)});
+    }
+    if (const auto stroke = GetStroke(text.style)) {
+        const double half_width = GetStrokeHalfWidth(text.style);
+        shapes.push_back({GlyphText{origin, scale, text.data, half_width}, *stroke, box.Expanded(half_width + 1.0)});
+    }
+}
+
+// ---------- Растеризация полосы ------------------
+
+// Высота полосы изображения, которую рисует один поток
+constexpr uint32_t BAND_HEIGHT = 32;
+// Ширина участка полосы, для которого отслеживается непрозрачность
+constexpr int TILE_WIDTH = 32;
+
+double Distance(double dx, double dy) {
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+// Покрытие пикселя краем фигуры: расстояние от центра пикселя до границы, сглаженное на пиксель
+float EdgeCoverage(double inside_distance) {
+    return static_cast<float>(std::clamp(inside_distance + 0.5, 0.0, 1.0));
+}
+
+// Пиксель считается непрозрачным, когда фигуры под ним уже не могут изменить его цвет
+// больше чем на половину шага 8-битного канала
+constexpr float OPAQUE_ALPHA = 1.0f - 1.0f / 512.0f;
+
+/*
+ * Рисует фигуры в полосу строк [first_row, last_row) от верхних к нижним: краска фигуры
+ * подкладывается под уже нарисованное (destination-over), поэтому непрозрачные пиксели, участки
+ * полосы и вся полоса дальше не обрабатываются. Покрытие фигуры сначала собирается в маску (части одной
+ * фигуры не смешиваются друг с другом), затем краска накладывается по маске на затронутые
+ * отрезки строк. Цвета хранятся умноженными на альфу
+ */
+class BandRasterizer {
+public:
+    BandRasterizer(uint32_t width, uint32_t first_row, uint32_t last_row)
+        : width_(static_cast<int>(width))
+        , first_row_(static_cast<int>(first_row))
+        , last_row_(static_cast<int>(last_row))
+        , pixels_(static_cast<size_t>(width) * (last_row - first_row))
+        , mask_(pixels_.size(), 0.0f)
+        , opaque_in_tile_((width_ + TILE_WIDTH - 1) / TILE_WIDTH, 0)
+    {}
+
+    // Рисует фигуру под уже нарисованными
+    void Draw(const Shape& shape) {
+        std::visit([this](const auto& geometry) { Cover(geometry); }, shape.geometry);
+        Composite(shape.paint);
+    }
+
+    // Все пиксели полосы непрозрачны: нижние фигуры не видны
+    bool IsOpaque() const {
+        return opaque_tiles_ == opaque_in_tile_.size();
+    }
+
+    // Переводит цвета полосы в пиксели изображения
+    void Store(Image& image) const {
+        uint8_t* out = image.pixels.data() + static_cast<size_t>(first_row_) * width_ * 4;
+        for (const auto& pixel : pixels_) {
+            if (pixel.alpha > 0.0f) {
+                *out++ = ToByte(pixel.red / pixel.alpha);
+                *out++ = ToByte(pixel.green / pixel.alpha);
+                *out++ = ToByte(pixel.blue / pixel.alpha);
+                *out++ = ToByte(pixel.alpha);
+            } else {
+                out = std::fill_n(out, 4, uint8_t{0});
+            }
+        }
+    }
+
+private:
+    // Отрезок строки, в котором маска могла измениться
+    struct Span {
+        int row = 0;
+        int first_x = 0;
+        int last_x = 0;
+    };
+
+    static uint8_t ToByte(float value) {
+        return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+    }
+
+    // Пикселей в участке полосы, начинающемся с x
+    int GetTileSize(int first_x) const {
+        return std::min(TILE_WIDTH, width_ - first_x) * (last_row_ - first_row_);
+    }
+
+    // Все пиксели участков полосы между min_x и max_x непрозрачны
+    bool IsOpaque(double min_x, double max_x) const {
+        const int first_tile = std::max(0, static_cast<int>(std::floor(min_x))) / TILE_WIDTH;
+        const int last_tile = std::min(width_ - 1, static_cast<int>(std::floor(max_x))) / TILE_WIDTH;
+        for (int tile = first_tile; tile <= last_tile; ++tile) {
+            if (opaque_in_tile_[tile] < GetTileSize(tile * TILE_WIDTH)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Для каждой строки полосы, пересекающей [min_y, max_y], вызывает cover_pixel(mask, x, y)
+    // для ещё не непрозрачных пикселей строки с центрами в пределах x_range(y); x, y - центр пикселя
+    template <typename XRange, typename CoverPixel>
+    void CoverRows(double min_y, double max_y, XRange x_range, CoverPixel cover_pixel) {
+        const int first_row = std::max(first_row_, static_cast<int>(std::floor(min_y)));
+        const int last_row = std::min(last_row_ - 1, static_cast<int>(std::floor(max_y)));
+        for (int row = first_row; row <= last_row; ++row) {
+            const double y = row + 0.5;
+            const auto [min_x, max_x] = x_range(y);
+            if (!(min_x <= max_x)) {
+                continue;
+            }
+            const int first_x = std::max(0, static_cast<int>(std::floor(min_x)));
+            const int last_x = std::min(width_ - 1, static_cast<int>(std::floor(max_x)));
+            if (first_x > last_x) {
+                continue;
+            }
+            const size_t row_offset = static_cast<size_t>(row - first_row_) * width_;
+            for (int x = first_x; x <= last_x; ++x) {
+                if (pixels_[row_offset + x].alpha < OPAQUE_ALPHA) {
+                    cover_pixel(mask_[row_offset + x], x + 0.5, y);
+                }
+            }
+            spans_.push_back({row - first_row_, first_x, last_x});
+        }
+    }
+
+    // Объединение частей фигуры: в маске остаётся наибольшее покрытие
+    static void Unite(float& mask, float coverage) {
+        mask = std::max(mask, coverage);
+    }
+
+    // Капсула радиуса radius вокруг отрезка [from, to]
+    void CoverCapsule(svg::Point from, svg::Point to, double radius) {
+        const double reach = radius + 0.5;
+        if (IsOpaque(std::min(from.x, to.x) - reach, std::max(from.x, to.x) + reach)) {
+            return;
+        }
+        const double dx = to.x - from.x;
+        const double dy = to.y - from.y;
+        const double length_sq = dx * dx + dy * dy;
+        const double length = std::sqrt(length_sq);
+        CoverRows(std::min(from.y, to.y) - reach, std::max(from.y, to.y) + reach,
+            [&](double y) {
+                double min_x = std::min(from.x, to.x) - reach;
+                double max_x = std::max(from.x, to.x) + reach;
+                // Строка пересекает полосу шириной 2 * reach вокруг прямой отрезка
+                if (std::abs(dy) > 1e-9) {
+                    double left = from.x + (dx * (y - from.y) - reach * length) / dy;
+                    double right = from.x + (dx * (y - from.y) + reach * length) / dy;
+                    if (left > right) {
+                        std::swap(left, right);
+                    }
+                    min_x = std::max(min_x, left);
+                    max_x = std::min(max_x, right);
+                }
+                return std::pair{min_x, max_x};
+            },
+            [&](float& mask, double x, double y) {
+                double t = length_sq > 0.0 ? ((x - from.x) * dx + (y - from.y) * dy) / length_sq : 0.0;
+                t = std::clamp(t, 0.0, 1.0);
+                Unite(mask, EdgeCoverage(radius - Distance(x - from.x - t * dx, y - from.y - t * dy)));
+            });
+    }
+
+    void Cover(const StrokedPolyline& polyline) {
+        for (size_t i = 1; i < polyline.points.size(); ++i) {
+            CoverCapsule(polyline.points[i - 1], polyline.points[i], polyline.half_width);
+        }
+    }
+
+    // Пиксели на расстоянии не больше reach от center
+    template <typename CoverPixel>
+    void CoverDiskRows(svg::Point center, double reach, CoverPixel cover_pixel) {
+        if (IsOpaque(center.x - reach, center.x + reach)) {
+            return;
+        }
+        CoverRows(center.y - reach, center.y + reach,
+            [&](double y) {
+                const double half_chord = std::sqrt(std::max(0.0, reach * reach - (y - center.y) * (y - center.y)));
+                return std::pair{center.x - half_chord, center.x + half_chord};
+            },
+            cover_pixel);
+    }
+
+    void Cover(const FilledDisk& disk) {
+        CoverDiskRows(disk.center, disk.radius + 0.5, [&](float& mask, double x, double y) {
+            Unite(mask, EdgeCoverage(disk.radius - Distance(x - disk.center.x, y - disk.center.y)));
+        });
+    }
+
+    void Cover(const StrokedCircle& circle) {
+        CoverDiskRows(circle.center, circle.radius + circle.half_width + 0.5, [&](float& mask, double x, double y) {
+            const double distance = Distance(x - circle.center.x, y - circle.center.y);
+            Unite(mask, EdgeCoverage(circle.half_width - std::abs(distance - circle.radius)));
+        });
+    }
+
+    void Cover(const GlyphText& text) {
+        double glyph_x = text.origin.x;
+        const double top = text.origin.y - GLYPH_HEIGHT * text.scale;
+        const double reach = text.half_width + 0.5;
+        for (size_t pos = 0; pos < text.data.size(); glyph_x += GLYPH_ADVANCE * text.scale) {
+            const Glyph& glyph = NextGlyph(text.data, pos);
+            if (glyph_x - reach >= width_) {
+                break;
+            }
+            for (size_t column = 0; column < glyph.size(); ++column) {
+                for (int row = 0; row < GLYPH_HEIGHT; ++row) {
+                    if (((glyph[column] >> row) & 1) == 0) {
+                        continue;
+                    }
+                    const Box cell{glyph_x + column * text.scale, top + row * text.scale,
+                                   glyph_x + (column + 1) * text.scale, top + (row + 1) * text.scale};
+                    if (text.half_width > 0.0) {
+                        CoverStrokedCell(cell, text.half_width);
+                    } else {
+                        CoverFilledCell(cell);
+                    }
+                }
+            }
+        }
+    }
+
+    // Клетки глифа не перекрываются: покрытие пикселя - сумма площадей его пересечений с клетками
+    void CoverFilledCell(const Box& cell) {
+        if (IsOpaque(cell.min_x, cell.max_x)) {
+            return;
+        }
+        CoverRows(cell.min_y, cell.max_y,
+            [&](double) { return std::pair{cell.min_x, cell.max_x}; },
+            [&](float& mask, double x, double y) {
+                const double overlap_x = std::min(x + 0.5, cell.max_x) - std::max(x - 0.5, cell.min_x);
+                const double overlap_y = std::min(y + 0.5, cell.max_y) - std::max(y - 0.5, cell.min_y);
+                if (overlap_x > 0.0 && overlap_y > 0.0) {
+                    mask = std::min(1.0f, mask + static_cast<float>(overlap_x * overlap_y));
+                }
+            });
+    }
+
+    // Обводка глифа покрывает клетки и всё, что ближе half_width к ним
+    void CoverStrokedCell(const Box& cell, double half_width) {
+        const Box reach_box = cell.Expanded(half_width + 0.5);
+        if (IsOpaque(reach_box.min_x, reach_box.max_x)) {
+            return;
+        }
+        CoverRows(reach_box.min_y, reach_box.max_y,
+            [&](double) { return std::pair{reach_box.min_x, reach_box.max_x}; },
+            [&](float& mask, double x, double y) {
+                const double dx = std::max({cell.min_x - x, 0.0, x - cell.max_x});
+                const double dy = std::max({cell.min_y - y, 0.0, y - cell.max_y});
+                Unite(mask, EdgeCoverage(half_width - Distance(dx, dy)));
+            });
+    }
+
+    // Подкладывает краску по маске под нарисованное и очищает маску
+    void Composite(const Paint& paint) {
+        for (const auto& span : spans_) {
+            const size_t row_offset = static_cast<size_t>(span.row) * width_;
+            for (int x = span.first_x; x <= span.last_x; ++x) {
+                float& coverage = mask_[row_offset + x];
+                if (coverage <= 0.0f) {
+                    continue;
+                }
+                Paint& pixel = pixels_[row_offset + x];
+                const float weight = coverage * (1.0f - pixel.alpha);
+                pixel.red += paint.red * weight;
+                pixel.green += paint.green * weight;
+                pixel.blue += paint.blue * weight;
+                pixel.alpha += paint.alpha * weight;
+                coverage = 0.0f;
+                if (pixel.alpha >= OPAQUE_ALPHA) {
+                    const int tile = x / TILE_WIDTH;
+                    if (++opaque_in_tile_[tile] == GetTileSize(tile * TILE_WIDTH)) {
+                        ++opaque_tiles_;
+                    }
+                }
+            }
+        }
+        spans_.clear();
+    }
+
+    int width_;
+    int first_row_;
+    int last_row_;
+    std::vector<Paint> pixels_;
+    std::vector<float> mask_;
+    std::vector<Span> spans_;
+    // Число непрозрачных пикселей в каждом участке полосы и число полностью непрозрачных участков
+    std::vector<int> opaque_in_tile_;
+    size_t opaque_tiles_ = 0;
+};
+
+}  // namespace
+
+Image Rasterize(const svg::FlatDocument& document, uint32_t width, uint32_t height, size_t thread_count) {
+    Image image{width, height, std::vector<uint8_t>(static_cast<size_t>(width) * height * 4, 0)};
+    if (width == 0 || height == 0) {
+        return image;
+    }
+
+    std::vector<Shape> shapes;
+    document.VisitElements([&shapes](const auto& element) {
+        AddShapes(element, shapes);
+    });
+
+    // Раскладываем фигуры по полосам, которые они задевают, сохраняя порядок рисования
+    const size_t band_count = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+    std::vector<std::vector<uint32_t>> band_shapes(band_count);
+    for (uint32_t i = 0; i < shapes.size(); ++i) {
+        const Box& box = shapes[i].box;
+        if (box.max_x < 0.0 || box.min_x >= width || box.max_y < 0.0 || box.min_y >= height) {
+            continue;
+        }
+        const size_t first_band = static_cast<size_t>(std::max(0.0, box.min_y)) / BAND_HEIGHT;
+        const size_t last_band = std::min(band_count - 1, static_cast<size_t>(box.max_y) / BAND_HEIGHT);
+        for (size_t band = first_band; band <= last_band; ++band) {
+            band_shapes[band].push_back(i);
+        }
+    }
+
+    RunTasks(thread_count, band_count, [&](size_t band) {
+        const auto first_row = static_cast<uint32_t>(band * BAND_HEIGHT);
+        BandRasterizer rasterizer(width, first_row, std::min(height, first_row + BAND_HEIGHT));
+        const auto& band_order = band_shapes[band];
+        for (auto shape = band_order.rbegin(); shape != band_order.rend() && !rasterizer.IsOpaque(); ++shape) {
+            rasterizer.Draw(shapes[*shape]);
+        }
+        rasterizer.Store(image);
+    });
+    return image;
+}
+
+}  // namespace raster
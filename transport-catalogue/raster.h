@@ -0,0 +1,30 @@
+#pragma once
+
+#include "svg.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Растровый вывод карты: сглаженная построчная растеризация элементов svg::FlatDocument.
+ *
+ * Упрощения относительно SVG: ломаные рисуются только обводкой с круглыми концами и
+ * соединениями (заливка ломаных не рисуется), тексты - встроенным моноширинным шрифтом 5x7,
+ * масштабированным под font-size (font-family и font-weight не учитываются)
+ */
+
+namespace raster {
+
+// Изображение RGBA по 8 бит на канал без умножения на альфу, строки сверху вниз
+struct Image {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Растеризует документ в изображение width x height с прозрачным фоном. Изображение делится
+// на горизонтальные полосы, полосы рисуются параллельно в thread_count потоках
+Image Rasterize(const svg::FlatDocument& document, uint32_t width, uint32_t height, size_t thread_count = 1);
+
+}  // namespace raster
@@ -1,13 +1,43 @@
 #include "request_handler.h"
 
+#include "instrumentation.h"
+#include "json.h"
+#include "png.h"
+
+#include <sstream>
+
 using namespace std::literals;
 
 RequestHandler::RequestHandler(const transport::TransportCatalogue& db, 
-                               const renderer::MapRenderer& renderer)
+                               const renderer::MapRenderer& renderer,
+                               RouterBuildMode router_build_mode,
+                               const memory::Budget& memory_budget)
     : db_(db),
-      renderer_(renderer),
-      db_router_(TransportRouter(db))
-{}
+      renderer_(renderer)
+{
+    // При политике FAIL бюджет проверяется до фонового построения: ошибка должна случиться
+    // до первого ответа, а не при первом запросе Route
+    if (memory_budget.policy == memory::Budget::Policy::FAIL) {
+        memory_budget.Allows("router_table", TransportRouter::EstimateTableMemoryUsage(db));
+    }
+    auto build_router = [&db, memory_budget]() {
+        return std::shared_ptr<const TransportRouter>(std::make_shared<TransportRouter>(db, memory_budget));
+    };
+    switch (router_build_mode) {
+    case RouterBuildMode::IMMEDIATE: {
+        std::promise<std::shared_ptr<const TransportRouter>> router;
+        router.set_value(build_router());
+        db_router_ = router.get_future().share();
+        break;
+    }
+    case RouterBuildMode::BACKGROUND:
+        db_router_ = std::async(std::launch::async, build_router).share();
+        break;
+    case RouterBuildMode::ON_FIRST_ROUTE:
+        db_router_ = std::async(std::launch::deferred, build_router).share();
+        break;
+    }
+}
 
 std::optional<BusStat> RequestHandler::GetBusStat(std::string_view bus_name) const {
     auto bus(db_.GetBus(bus_name));
@@ -47,11 +77,171 @@ std::optional<StopStat> RequestHandler::GetStopStat(std::string_view stop_name)
 }
 
 std::optional<RouteInfo> RequestHandler::FindRoute(std::string_view stop_name_from, std::string_view stop_name_to) const {
-    return db_router_.FindRoute(db_.GetStop(stop_name_from), 
-                                db_.GetStop(stop_name_to));
+    return db_router_.get()->FindRoute(db_.GetStop(stop_name_from), 
+                                       db_.GetStop(stop_name_to));
+}
+
+svg::FlatDocument RequestHandler::RenderMap() const { 
+    TC_TRACE_SCOPE("render_map_document"sv);
+    return renderer_.RenderMap(*GetMapGeometry());
+}
+
+std::shared_ptr<const RenderedMap> RequestHandler::GetRenderedMap() const {
+    std::lock_guard lock(map_cache_mutex_);
+    if (map_cache_
+        && map_cache_db_version_ == db_.GetVersion()
+        && map_cache_renderer_version_ == renderer_.GetVersion()) {
+        return map_cache_;
+    }
+
+    TC_PHASE_SCOPE("render_map"sv);
+    auto rendered_map = std::make_shared<RenderedMap>();
+    {
+        TC_TRACE_SCOPE("render_map_document"sv);
+        renderer_.RenderMap(*GetMapGeometry(), map_fragments_, rendered_map->svg);
+    }
+
+    std::ostringstream escaped_out;
+    json::PrintEscapedString(rendered_map->svg, escaped_out);
+    rendered_map->json_escaped_svg = std::move(escaped_out).str();
+
+    map_cache_ = std::move(rendered_map);
+    map_cache_db_version_ = db_.GetVersion();
+    map_cache_renderer_version_ = renderer_.GetVersion();
+    return map_cache_;
+}
+
+std::shared_ptr<const std::string> RequestHandler::GetMapImage() const {
+    std::lock_guard lock(map_image_mutex_);
+    if (map_image_
+        && map_image_db_version_ == db_.GetVersion()
+        && map_image_renderer_version_ == renderer_.GetVersion()) {
+        return map_image_;
+    }
+
+    TC_PHASE_SCOPE("render_map_image"sv);
+    raster::Image image;
+    {
+        TC_TRACE_SCOPE("rasterize_map"sv);
+        image = renderer_.RasterizeMap(*GetMapGeometry());
+    }
+    auto png = std::make_shared<std::string>();
+    {
+        TC_TRACE_SCOPE("encode_png"sv);
+        raster::EncodePng(image, *png);
+    }
+
+    map_image_ = std::move(png);
+    map_image_db_version_ = db_.GetVersion();
+    map_image_renderer_version_ = renderer_.GetVersion();
+    return map_image_;
+}
+
+svg::FlatDocument RequestHandler::RenderViewport(const renderer::GeoBounds& bounds, double width, double height) const {
+    const auto map_index = GetMapIndex();
+    const auto route_detail = GetRouteDetail(map_index, renderer_.GetDetailLevel(bounds, width, height));
+    TC_TRACE_SCOPE("render_viewport"sv);
+    return renderer_.RenderViewport(*map_index, bounds, width, height, route_detail.get());
+}
+
+std::optional<svg::FlatDocument> RequestHandler::RenderTile(int zoom, int x, int y) const {
+    const auto map_index = GetMapIndex();
+    const auto bounds = map_index->GetTileBounds(zoom, x, y);
+    if (!bounds) {
+        return std::nullopt;
+    }
+    const auto route_detail = GetRouteDetail(map_index, renderer_.GetDetailLevel(*bounds, renderer::TILE_SIZE, renderer::TILE_SIZE));
+    const auto labels = GetTileLabels(map_index, zoom, *bounds);
+    TC_TRACE_SCOPE("render_viewport"sv);
+    return renderer_.RenderViewport(*map_index, *bounds, renderer::TILE_SIZE, renderer::TILE_SIZE,
+                                    route_detail.get(), labels.get());
+}
+
+void RequestHandler::RenderSvg(const svg::FlatDocument& document, std::string& svg) const {
+    renderer_.RenderSvg(document, svg);
+}
+
+std::shared_ptr<const renderer::MapIndex> RequestHandler::GetMapIndex() const {
+    std::lock_guard lock(map_index_mutex_);
+    if (!map_index_ || map_index_db_version_ != db_.GetVersion()) {
+        TC_PHASE_SCOPE("build_map_index"sv);
+        map_index_ = std::make_shared<renderer::MapIndex>(db_.GetBuses(), db_.GetRoundtripBuses());
+        map_index_db_version_ = db_.GetVersion();
+    }
+    return map_index_;
 }
 
-svg::Document RequestHandler::RenderMap() const { 
-    return renderer_.RenderMap(db_.GetBuses(),
-                               db_.GetRoundtripBuses());
+std::shared_ptr<const renderer::MapGeometry> RequestHandler::GetMapGeometry() const {
+    auto map_index = GetMapIndex();
+    std::lock_guard lock(map_geometry_mutex_);
+    if (!map_geometry_ || map_geometry_->index != map_index || map_geometry_renderer_version_ != renderer_.GetVersion()) {
+        TC_PHASE_SCOPE("project_map_stops"sv);
+        map_geometry_ = std::make_shared<renderer::MapGeometry>(renderer_.ProjectStops(std::move(map_index)));
+        map_geometry_renderer_version_ = renderer_.GetVersion();
+    }
+    return map_geometry_;
+}
+
+std::shared_ptr<const renderer::RouteDetail> RequestHandler::GetRouteDetail(
+        const std::shared_ptr<const renderer::MapIndex>& map_index, std::optional<int> detail_level) const {
+    if (!detail_level) {
+        return nullptr;
+    }
+    std::lock_guard lock(route_detail_mutex_);
+    if (route_detail_index_ != map_index || route_detail_renderer_version_ != renderer_.GetVersion()) {
+        route_details_.clear();
+        route_detail_index_ = map_index;
+        route_detail_renderer_version_ = renderer_.GetVersion();
+    }
+    auto& route_detail = route_details_[*detail_level];
+    if (!route_detail) {
+        route_detail = std::make_shared<const renderer::RouteDetail>(renderer_.SimplifyRoutes(*map_index, *detail_level));
+    }
+    return route_detail;
+}
+
+std::shared_ptr<const renderer::LabelPlacement> RequestHandler::GetTileLabels(
+        const std::shared_ptr<const renderer::MapIndex>& map_index, int zoom, const renderer::GeoBounds& tile_bounds) const {
+    std::lock_guard lock(tile_labels_mutex_);
+    if (tile_labels_index_ != map_index || tile_labels_renderer_version_ != renderer_.GetVersion()) {
+        tile_labels_.clear();
+        tile_labels_index_ = map_index;
+        tile_labels_renderer_version_ = renderer_.GetVersion();
+    }
+    auto& labels = tile_labels_[zoom];
+    if (!labels) {
+        labels = std::make_shared<const renderer::LabelPlacement>(
+            renderer_.PlaceViewportLabels(*map_index, tile_bounds, renderer::TILE_SIZE, renderer::TILE_SIZE));
+    }
+    return labels;
+}
+
+void RequestHandler::RecordMemoryUsage(std::string name, size_t bytes) {
+    recorded_memory_usage_.Add(std::move(name), bytes);
+}
+
+memory::Report RequestHandler::GetMemoryUsage() const {
+    memory::Report report(recorded_memory_usage_);
+    db_.ReportMemoryUsage(report);
+    if (db_router_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        db_router_.get()->ReportMemoryUsage(report);
+    }
+
+    {
+        std::lock_guard lock(map_geometry_mutex_);
+        report.Add("map_geometry", map_geometry_ ? map_geometry_->GetMemoryUsage() : 0);
+    }
+    std::lock_guard lock(map_cache_mutex_);
+    report.Add("rendered_map", map_cache_ ? map_cache_->svg.capacity() + map_cache_->json_escaped_svg.capacity() : 0);
+    report.Add("map_fragments", map_fragments_.GetMemoryUsage());
+    std::lock_guard image_lock(map_image_mutex_);
+    report.Add("map_image", map_image_ ? map_image_->capacity() : 0);
+    return report;
+}
+
+std::string_view RequestHandler::GetRoutingMode() const {
+    if (db_router_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return "not_built"sv;
+    }
+    return db_router_.get()->IsPrecomputed() ? "all_pairs"sv : "dijkstra"sv;
 }
@@ -2,12 +2,20 @@
 
 #include "graph.h"
 #include "map_renderer.h"
+#include "memory_accounting.h"
 #include "router.h"
 #include "svg.h"
 #include "transport_catalogue.h"
 #include "transport_router.h"
 
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <set>
+#include <string>
 
 /*
  * Код обработчика запросов к базе, содержащего логику, которую не
@@ -29,10 +37,28 @@ struct StopStat {
     std::set<std::string> bus_names;
 };
 
+// Отрендеренная карта: SVG текст и он же, экранированный для вставки в строку JSON
+struct RenderedMap {
+    std::string svg;
+    std::string json_escaped_svg;
+};
+
+// Когда строить граф маршрутов (таблица всех кратчайших путей занимает O(V^2) памяти)
+enum class RouterBuildMode {
+    IMMEDIATE,       // в конструкторе RequestHandler
+    BACKGROUND,      // в отдельном потоке, запросы Route ждут готовности
+    ON_FIRST_ROUTE   // при первом запросе Route
+};
+
+// Все методы RequestHandler константные и только читают каталог, граф маршрутов и настройки рендера
+// (кэш карты защищён мьютексом), поэтому после создания обработчик можно вызывать из нескольких потоков одновременно
 class RequestHandler {
 public:
     // MapRenderer понадобится в следующей части итогового проекта
-    RequestHandler(const transport::TransportCatalogue& db, const renderer::MapRenderer& renderer);
+    // memory_budget ограничивает таблицу кратчайших путей (см. TransportRouter)
+    RequestHandler(const transport::TransportCatalogue& db, const renderer::MapRenderer& renderer,
+                   RouterBuildMode router_build_mode = RouterBuildMode::IMMEDIATE,
+                   const memory::Budget& memory_budget = {});
 
     // Возвращает информацию о маршруте (запрос Bus)
     std::optional<BusStat> GetBusStat(std::string_view bus_name) const;
@@ -44,11 +70,81 @@ public:
     std::optional<RouteInfo> FindRoute(std::string_view stop_name_from, std::string_view stop_name_to) const;
 
     // Рендерит транспортный каталог
-    svg::Document RenderMap() const;
+    svg::FlatDocument RenderMap() const;
+
+    // Возвращает готовый текст карты. Карта рендерится один раз и кэшируется,
+    // кэш сбрасывается только при изменении каталога или настроек рендера
+    std::shared_ptr<const RenderedMap> GetRenderedMap() const;
+
+    // Возвращает карту в формате PNG (запрос MapImage); кэшируется так же, как текст карты
+    std::shared_ptr<const std::string> GetMapImage() const;
+
+    // Рендерит область карты bounds в изображение width x height (запрос MapTile и веб-карта)
+    svg::FlatDocument RenderViewport(const renderer::GeoBounds& bounds, double width, double height) const;
+
+    // Рендерит тайл zoom/x/y размером renderer::TILE_SIZE; nullopt, если такого тайла нет
+    std::optional<svg::FlatDocument> RenderTile(int zoom, int x, int y) const;
+
+    // Дописывает текст документа в формате, заданном настройками рендера
+    void RenderSvg(const svg::FlatDocument& document, std::string& svg) const;
+
+    // Запоминает размер структуры, которой владеет вызывающий код (например, JSON документа),
+    // чтобы показывать его в отчёте о памяти. Вызывается до начала обработки запросов
+    void RecordMemoryUsage(std::string name, size_t bytes);
+
+    // Память по подсистемам (запрос Stats). Граф маршрутов учитывается, только если уже построен
+    memory::Report GetMemoryUsage() const;
+
+    // "all_pairs", "dijkstra" или "not_built", если граф маршрутов ещё не построен
+    std::string_view GetRoutingMode() const;
 
 private:
     // RequestHandler использует агрегацию объектов "Транспортный Справочник" и "Визуализатор Карты"
     const transport::TransportCatalogue& db_;
     const renderer::MapRenderer& renderer_;
-    TransportRouter db_router_;
+    std::shared_future<std::shared_ptr<const TransportRouter>> db_router_;
+    memory::Report recorded_memory_usage_;
+
+    // Пространственный индекс карты строится при первом рендере и перестраивается при изменении каталога
+    std::shared_ptr<const renderer::MapIndex> GetMapIndex() const;
+    // Спроецированные остановки перестраиваются также при изменении настроек рендера
+    std::shared_ptr<const renderer::MapGeometry> GetMapGeometry() const;
+    // Упрощённые ломаные кэшируются по уровням детализации; nullptr, если упрощение выключено
+    std::shared_ptr<const renderer::RouteDetail> GetRouteDetail(const std::shared_ptr<const renderer::MapIndex>& map_index,
+                                                                std::optional<int> detail_level) const;
+    // Подписи всей сети, отобранные в масштабе тайлов уровня zoom, кэшируются по уровням:
+    // все тайлы уровня выводят одни и те же подписи
+    std::shared_ptr<const renderer::LabelPlacement> GetTileLabels(const std::shared_ptr<const renderer::MapIndex>& map_index,
+                                                                  int zoom, const renderer::GeoBounds& tile_bounds) const;
+
+    // Кэш карты с версиями каталога и настроек, по которым он построен
+    mutable std::mutex map_cache_mutex_;
+    mutable std::shared_ptr<const RenderedMap> map_cache_;
+    mutable uint64_t map_cache_db_version_ = 0;
+    mutable uint64_t map_cache_renderer_version_ = 0;
+    // Фрагменты текста карты: после изменения каталога перерендериваются только изменившиеся
+    mutable renderer::MapFragmentCache map_fragments_;
+
+    mutable std::mutex map_image_mutex_;
+    mutable std::shared_ptr<const std::string> map_image_;
+    mutable uint64_t map_image_db_version_ = 0;
+    mutable uint64_t map_image_renderer_version_ = 0;
+
+    mutable std::mutex map_index_mutex_;
+    mutable std::shared_ptr<const renderer::MapIndex> map_index_;
+    mutable uint64_t map_index_db_version_ = 0;
+
+    mutable std::mutex map_geometry_mutex_;
+    mutable std::shared_ptr<const renderer::MapGeometry> map_geometry_;
+    mutable uint64_t map_geometry_renderer_version_ = 0;
+
+    mutable std::mutex route_detail_mutex_;
+    mutable std::map<int, std::shared_ptr<const renderer::RouteDetail>> route_details_;
+    mutable std::shared_ptr<const renderer::MapIndex> route_detail_index_;
+    mutable uint64_t route_detail_renderer_version_ = 0;
+
+    mutable std::mutex tile_labels_mutex_;
+    mutable std::map<int, std::shared_ptr<const renderer::LabelPlacement>> tile_labels_;
+    mutable std::shared_ptr<const renderer::MapIndex> tile_labels_index_;
+    mutable uint64_t tile_labels_renderer_version_ = 0;
 };
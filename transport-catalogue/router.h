@@ -1,12 +1,15 @@
 #pragma once
 
 #include "graph.h"
+#include "tracing.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <iterator>
+#include <functional>
 #include <optional>
+#include <queue>
 #include <stdexcept>
 #include <unordered_map>
 #include <utility>
@@ -29,6 +32,10 @@ public:
 
     std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
 
+    // Память таблицы кратчайших путей для графа с vertex_count вершинами (до её построения)
+    static size_t EstimateMemoryUsage(size_t vertex_count);
+    size_t GetMemoryUsage() const;
+
 private:
     struct RouteInternalData {
         Weight weight;
@@ -86,14 +93,29 @@ Router<Weight>::Router(const Graph& graph)
     , routes_internal_data_(graph.GetVertexCount(),
                             std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
 {
-    InitializeRoutesInternalData(graph);
+    {
+        TC_TRACE_SCOPE("router_initialize");
+        InitializeRoutesInternalData(graph);
+    }
 
+    TC_TRACE_SCOPE("router_relax");
     const size_t vertex_count = graph.GetVertexCount();
     for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
         RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
     }
 }
 
+template <typename Weight>
+size_t Router<Weight>::EstimateMemoryUsage(size_t vertex_count) {
+    return vertex_count * (sizeof(std::vector<std::optional<RouteInternalData>>)
+                           + vertex_count * sizeof(std::optional<RouteInternalData>));
+}
+
+template <typename Weight>
+size_t Router<Weight>::GetMemoryUsage() const {
+    return EstimateMemoryUsage(routes_internal_data_.size());
+}
+
 template <typename Weight>
 std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from,
                                                                              VertexId to) const {
@@ -114,4 +136,70 @@ std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(Ver
     return RouteInfo{weight, std::move(edges)};
 }
 
+// Маршрутизатор без предрасчёта: каждый маршрут ищется алгоритмом Дейкстры.
+// Памяти требует O(V + E) вместо O(V^2), но каждый запрос стоит O(E log V)
+template <typename Weight>
+class DijkstraRouter {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+
+    explicit DijkstraRouter(const Graph& graph)
+        : graph_(graph)
+    {}
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+private:
+    const Graph& graph_;
+};
+
+template <typename Weight>
+std::optional<typename DijkstraRouter<Weight>::RouteInfo> DijkstraRouter<Weight>::BuildRoute(VertexId from,
+                                                                                             VertexId to) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    std::vector<std::optional<Weight>> weights(vertex_count);
+    std::vector<std::optional<EdgeId>> prev_edges(vertex_count);
+    using QueueItem = std::pair<Weight, VertexId>;
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+
+    weights.at(from) = Weight{};
+    queue.emplace(Weight{}, from);
+    while (!queue.empty()) {
+        const auto [weight, vertex] = queue.top();
+        queue.pop();
+        if (vertex == to) {
+            break;
+        }
+        if (weight > *weights[vertex]) {
+            continue;
+        }
+        for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            if (edge.weight < Weight{}) {
+                throw std::domain_error("Edges' weights should be non-negative");
+            }
+            const Weight candidate_weight = weight + edge.weight;
+            if (!weights[edge.to] || candidate_weight < *weights[edge.to]) {
+                weights[edge.to] = candidate_weight;
+                prev_edges[edge.to] = edge_id;
+                queue.emplace(candidate_weight, edge.to);
+            }
+        }
+    }
+
+    if (!weights.at(to)) {
+        return std::nullopt;
+    }
+    std::vector<EdgeId> edges;
+    for (std::optional<EdgeId> edge_id = prev_edges[to]; edge_id; edge_id = prev_edges[graph_.GetEdge(*edge_id).from]) {
+        edges.push_back(*edge_id);
+    }
+    std::reverse(edges.begin(), edges.end());
+
+    return RouteInfo{*weights[to], std::move(edges)};
+}
+
 }  // namespace graph
\ No newline at end of file
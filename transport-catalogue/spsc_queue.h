@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/*
+ * Ограниченная очередь без блокировок для одного производителя и одного потребителя.
+ * Производитель ждёт освобождения места, потребитель - появления элемента
+ * (ожидание через std::atomic::wait, без мьютексов).
+ */
+
+template <typename T>
+class SpscQueue {
+public:
+    // capacity округляется вверх до степени двойки
+    explicit SpscQueue(size_t capacity)
+        : slots_(RoundUpToPowerOfTwo(capacity))
+        , mask_(slots_.size() - 1)
+    {}
+
+    // Вызывается только производителем
+    void Push(T value) {
+        const uint64_t tail = tail_.load(std::memory_order_relaxed);
+        for (uint64_t head = head_.load(std::memory_order_acquire);
+             tail - head == slots_.size();
+             head = head_.load(std::memory_order_acquire)) {
+            head_.wait(head, std::memory_order_acquire);
+        }
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        tail_.notify_one();
+    }
+
+    // Вызывается только производителем: больше элементов не будет
+    void Close() {
+        tail_.fetch_or(CLOSED_BIT, std::memory_order_release);
+        tail_.notify_one();
+    }
+
+    // Вызывается только потребителем: возвращает nullopt, когда очередь закрыта и пуста
+    std::optional<T> Pop() {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t tail = tail_.load(std::memory_order_acquire);
+        while ((tail & ~CLOSED_BIT) == head) {
+            if (tail & CLOSED_BIT) {
+                return std::nullopt;
+            }
+            tail_.wait(tail, std::memory_order_acquire);
+            tail = tail_.load(std::memory_order_acquire);
+        }
+        std::optional<T> value(std::move(slots_[head & mask_]));
+        head_.store(head + 1, std::memory_order_release);
+        head_.notify_one();
+        return value;
+    }
+
+private:
+    static size_t RoundUpToPowerOfTwo(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    static constexpr uint64_t CLOSED_BIT = uint64_t{1} << 63;
+
+    std::vector<T> slots_;
+    const uint64_t mask_;
+    // Индексы растут монотонно; старший бит tail_ - признак закрытия очереди
+    alignas(64) std::atomic<uint64_t> head_{0};
+    alignas(64) std::atomic<uint64_t> tail_{0};
+};
@@ -0,0 +1,84 @@
+#include "startup_pipeline.h"
+
+#include "instrumentation.h"
+#include "json.h"
+#include "json_reader.h"
+#include "map_renderer.h"
+#include "request_handler.h"
+#include "spsc_queue.h"
+#include "transport_catalogue.h"
+
+#include <deque>
+#include <exception>
+#include <future>
+#include <optional>
+#include <utility>
+
+namespace transport {
+
+namespace {
+
+// Ёмкость очереди между разбором и наполнением каталога
+constexpr size_t BASE_REQUEST_QUEUE_CAPACITY = 1024;
+
+}  // namespace
+
+void RunPipeline(std::istream& input, std::ostream& output, size_t thread_count,
+                 const memory::Budget& memory_budget,
+                 const std::function<void(const RequestHandler&)>& on_finish) {
+    TransportCatalogue db;
+    SpscQueue<json::Node> base_requests(BASE_REQUEST_QUEUE_CAPACITY);
+
+    // Стадия 1: разбор документа, элементы base_requests уходят в очередь по мере разбора
+    auto parsed_doc = std::async(std::launch::async, [&input, &base_requests]() {
+        struct QueueCloser {
+            SpscQueue<json::Node>& queue;
+            ~QueueCloser() { queue.Close(); }
+        } closer{base_requests};
+        TC_TRACE_SCOPE("json_parse_streaming");
+        return json::LoadStreaming(input, "base_requests", [&base_requests](json::Node node) {
+            base_requests.Push(std::move(node));
+        });
+    });
+
+    // Стадия 2: наполнение каталога в текущем потоке.
+    // Узлы храним до Finish: разобранные запросы ссылаются на их строки
+    std::deque<json::Node> base_request_nodes;
+    BaseRequestsIngestor ingestor(db);
+    try {
+        TC_PHASE_SCOPE("pipeline_parse_and_ingest");
+        while (auto node = base_requests.Pop()) {
+            ingestor.Add(base_request_nodes.emplace_back(std::move(*node)));
+        }
+    } catch (...) {
+        // Освобождаем очередь, иначе поток разбора не сможет завершиться
+        while (base_requests.Pop()) {
+        }
+        throw;
+    }
+    json::Document doc(parsed_doc.get());
+    ingestor.Finish();
+    base_request_nodes.clear();
+
+    FillRoutingSettings(db, doc);
+    renderer::MapRenderer map_renderer;
+    renderer::FillMapRenderer(map_renderer, doc);
+    map_renderer.SetThreadCount(thread_count);
+
+    // Стадия 3: каталог заморожен. Граф маршрутов и карта строятся в фоне,
+    // запросы Route и Map ждут их, остальные отвечаются сразу
+    RequestHandler request_handler(db, map_renderer, RouterBuildMode::BACKGROUND, memory_budget);
+    // Элементы base_requests в документе не хранятся: они освобождаются после наполнения каталога
+    request_handler.RecordMemoryUsage("json_dom", json::GetHeapBytes(doc.GetRoot()));
+    auto map_warmup = std::async(std::launch::async, [&request_handler]() {
+        request_handler.GetRenderedMap();
+    });
+
+    ExecuteStatRequests(request_handler, doc, output, thread_count);
+    map_warmup.get();
+    if (on_finish) {
+        on_finish(request_handler);
+    }
+}
+
+}  // namespace transport
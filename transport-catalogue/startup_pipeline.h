@@ -0,0 +1,27 @@
+#pragma once
+
+#include "memory_accounting.h"
+#include "request_handler.h"
+
+#include <cstddef>
+#include <functional>
+#include <iostream>
+
+/*
+ * Конвейерный запуск: разбор входного документа, наполнение каталога, построение
+ * графа маршрутов, подготовка карты и ответы на запросы идут одновременно.
+ *
+ *  поток разбора  --(очередь base_requests)-->  поток наполнения каталога
+ *  после заморозки каталога:  граф маршрутов и карта строятся в фоне,
+ *  запросы Bus/Stop отвечаются сразу, Route/Map ждут готовности своих данных.
+ */
+
+namespace transport {
+
+// Выполняет весь документ (base_requests, настройки, stat_requests) и печатает ответы в output.
+// on_finish вызывается после ответа на все запросы, пока обработчик ещё жив
+void RunPipeline(std::istream& input, std::ostream& output, size_t thread_count,
+                 const memory::Budget& memory_budget = {},
+                 const std::function<void(const RequestHandler&)>& on_finish = {});
+
+}  // namespace transport
@@ -1,18 +1,264 @@
 #include "svg.h"
 
+#include <algorithm>
 #include <array>
+#include <charconv>
+#include <cmath>
+#include <iterator>
+#include <map>
 
 namespace svg {
 
 using namespace std::literals;
 
+// ---------- RenderBuffer ------------------
+
+RenderBuffer& RenderBuffer::operator<<(double value) {
+    std::array<char, 32> chars;
+    const auto result = std::to_chars(chars.data(), chars.data() + chars.size(), value, std::chars_format::general, 6);
+    data_.append(chars.data(), result.ptr);
+    return *this;
+}
+
+RenderBuffer& RenderBuffer::operator<<(unsigned value) {
+    std::array<char, 16> chars;
+    const auto result = std::to_chars(chars.data(), chars.data() + chars.size(), value);
+    data_.append(chars.data(), result.ptr);
+    return *this;
+}
+
+// ---------- PathStyle, Font ------------------
+
+void PathStyle::Render(RenderBuffer& out) const {
+    if (fill_color) {
+        out << " fill=\""sv << *fill_color << "\""sv;
+    }
+    if (stroke_color) {
+        out << " stroke=\""sv << *stroke_color << "\""sv;
+    }
+    if (stroke_width) {
+        out << " stroke-width=\""sv << *stroke_width << "\""sv;
+    }
+    if (stroke_line_cap) {
+        out << " stroke-linecap=\""sv << *stroke_line_cap << "\""sv;
+    }
+    if (stroke_line_join) {
+        out << " stroke-linejoin=\""sv << *stroke_line_join << "\""sv;
+    }
+}
+
+void Font::Render(RenderBuffer& out) const {
+    out << "font-size=\""sv << size << "\" "sv;
+    if (family) {
+        out << "font-family=\""sv << *family << "\" "sv;
+    }
+    if (weight) {
+        out << "font-weight=\""sv << *weight << "\" "sv;
+    }
+}
+
+namespace {
+
+constexpr std::string_view DOCUMENT_HEADER = "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+                                             "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
+constexpr std::string_view DOCUMENT_FOOTER = "</svg>"sv;
+
+// Разметка элементов общая для Document и FlatDocument, чтобы их вывод совпадал байт в байт
+
+// Экранирует спецсимволы XML за один проход, без копии текста
+void RenderEscapedText(RenderBuffer& out, std::string_view text) {
+    for (size_t pos = text.find_first_of("&\"'<>"sv); pos != std::string_view::npos; pos = text.find_first_of("&\"'<>"sv)) {
+        out << text.substr(0, pos);
+        switch (text[pos]) {
+        case '&': out << "&amp;"sv; break;
+        case '"': out << "&quot;"sv; break;
+        case '\'': out << "&apos;"sv; break;
+        case '<': out << "&lt;"sv; break;
+        default: out << "&gt;"sv; break;
+        }
+        text.remove_prefix(pos + 1);
+    }
+    out << text;
+}
+
+void RenderCircle(RenderBuffer& out, Point center, double radius, const PathStyle& style) {
+    out << "<circle cx=\""sv << center.x << "\" cy=\""sv << center.y << "\" "sv;
+    out << "r=\""sv << radius << "\" "sv;
+    style.Render(out);
+    out << "/>"sv;
+}
+
+template <typename PointIt>
+void RenderPolyline(RenderBuffer& out, PointIt first, PointIt last, const PathStyle& style) {
+    out << "<polyline points=\""sv;
+    for (auto it = first; it != last; ++it) {
+        if (it != first) {
+            out << " "sv;
+        }
+        out << (*it).x << ","sv << (*it).y;
+    }
+    out << "\" "sv;
+    style.Render(out);
+    out << "/>"sv;
+}
+
+void RenderText(RenderBuffer& out, Point position, Point offset, std::string_view text,
+                const Font& font, const PathStyle& style) {
+    out << "<text x=\""sv << position.x << "\" y=\""sv << position.y << "\" "sv;
+    out << "dx=\""sv << offset.x << "\" dy=\""sv << offset.y << "\" "sv;
+    font.Render(out);
+    style.Render(out);
+    out << ">"sv;
+    RenderEscapedText(out, text);
+    out << "</text>"sv;
+}
+
+// Компактный вывод FlatDocument
+
+constexpr std::array<int64_t, FlatDocument::MAX_COMPACT_PRECISION + 1> POWERS_OF_TEN = {
+    1, 10, 100, 1'000, 10'000, 100'000, 1'000'000};
+
+// Число в единицах 10^-precision
+int64_t Quantize(double value, int precision) {
+    return std::llround(value * static_cast<double>(POWERS_OF_TEN[precision]));
+}
+
+// Выводит units * 10^-precision без незначащих нулей и без нуля целой части: 0.5 -> .5
+void RenderFixed(RenderBuffer& out, int64_t units, int precision) {
+    if (units < 0) {
+        out << '-';
+        units = -units;
+    }
+    const int64_t divisor = POWERS_OF_TEN[precision];
+    const int64_t integer = units / divisor;
+    int64_t fraction = units % divisor;
+
+    std::array<char, 24> chars;
+    if (integer != 0 || fraction == 0) {
+        const auto result = std::to_chars(chars.data(), chars.data() + chars.size(), integer);
+        out << std::string_view(chars.data(), static_cast<size_t>(result.ptr - chars.data()));
+    }
+    if (fraction != 0) {
+        int digits = precision;
+        for (; fraction % 10 == 0; fraction /= 10) {
+            --digits;
+        }
+        chars[0] = '.';
+        for (int i = digits; i > 0; --i, fraction /= 10) {
+            chars[i] = static_cast<char>('0' + fraction % 10);
+        }
+        out << std::string_view(chars.data(), static_cast<size_t>(digits + 1));
+    }
+}
+
+// Число в списке координат: перед отрицательным разделитель не нужен, его роль играет минус
+void RenderNextFixed(RenderBuffer& out, int64_t units, int precision) {
+    if (units >= 0) {
+        out << ' ';
+    }
+    RenderFixed(out, units, precision);
+}
+
+void RenderFixedAttribute(RenderBuffer& out, std::string_view name, double value, int precision) {
+    out << ' ' << name << "=\""sv;
+    RenderFixed(out, Quantize(value, precision), precision);
+    out << '"';
+}
+
+// Атрибут d элемента <path>: первая вершина абсолютная, остальные - смещения от предыдущей.
+// Смещения считаются между округлёнными вершинами, поэтому ошибка округления не накапливается
+template <typename PointIt>
+void RenderPathData(RenderBuffer& out, PointIt first, PointIt last, int precision) {
+    if (first == last) {
+        return;
+    }
+    int64_t x = Quantize(first->x, precision);
+    int64_t y = Quantize(first->y, precision);
+    out << 'M';
+    RenderFixed(out, x, precision);
+    RenderNextFixed(out, y, precision);
+
+    bool has_segments = false;
+    for (auto it = std::next(first); it != last; ++it) {
+        const int64_t next_x = Quantize(it->x, precision);
+        const int64_t next_y = Quantize(it->y, precision);
+        // Вершины, совпавшие после округления, не меняют линию. Но если вся ломаная
+        // стянулась в точку, один нулевой отрезок оставляем: с круглыми концами это точка
+        const bool is_last = std::next(it) == last;
+        if (next_x == x && next_y == y && (has_segments || !is_last)) {
+            continue;
+        }
+        if (!has_segments) {
+            out << 'l';
+            RenderFixed(out, next_x - x, precision);
+        } else {
+            RenderNextFixed(out, next_x - x, precision);
+        }
+        RenderNextFixed(out, next_y - y, precision);
+        has_segments = true;
+        x = next_x;
+        y = next_y;
+    }
+}
+
+// Свойства оформления в синтаксисе CSS; для подложки подписи заливка не выводится
+void RenderStyleDeclarations(RenderBuffer& out, const PathStyle& style, bool with_fill) {
+    if (with_fill && style.fill_color) {
+        out << "fill:"sv << *style.fill_color << ';';
+    }
+    if (style.stroke_color) {
+        out << "stroke:"sv << *style.stroke_color << ';';
+    }
+    if (style.stroke_width) {
+        out << "stroke-width:"sv << *style.stroke_width << "px;"sv;
+    }
+    if (style.stroke_line_cap) {
+        out << "stroke-linecap:"sv << *style.stroke_line_cap << ';';
+    }
+    if (style.stroke_line_join) {
+        out << "stroke-linejoin:"sv << *style.stroke_line_join << ';';
+    }
+}
+
+void RenderFontDeclarations(RenderBuffer& out, const Font& font) {
+    out << "font-size:"sv << font.size << "px;"sv;
+    if (font.family) {
+        out << "font-family:"sv << *font.family << ';';
+    }
+    if (font.weight) {
+        out << "font-weight:"sv << *font.weight << ';';
+    }
+}
+
+// Непрозрачная заливка полностью закрывает заливку подложки под тем же текстом.
+// Цвета, заданные строкой, считаются непрозрачными, кроме явно прозрачных
+bool IsOpaque(const Color& color) {
+    if (const auto* rgba = std::get_if<Rgba>(&color)) {
+        return rgba->opacity >= 1.0;
+    }
+    if (const auto* name = std::get_if<std::string>(&color)) {
+        return *name != NoneColor && *name != "transparent"sv;
+    }
+    return std::holds_alternative<Rgb>(color);
+}
+
+bool operator==(Point lhs, Point rhs) {
+    return lhs.x == rhs.x && lhs.y == rhs.y;
+}
+
+void WriteTo(std::ostream& out, const std::string& data) {
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+}  // namespace
+
 void Object::Render(const RenderContext& context) const {
     context.RenderIndent();
 
     // Делегируем вывод тега своим подклассам
     RenderObject(context);
 
-    context.out << std::endl;
+    context.out << '\n';
 }
 
 // ---------- Circle ------------------
@@ -28,12 +274,7 @@ Circle& Circle::SetRadius(double radius)  {
 }
 
 void Circle::RenderObject(const RenderContext& context) const {
-    auto& out = context.out;
-
-    out << "<circle cx=\""sv << center_.x << "\" cy=\""sv << center_.y << "\" "sv;
-    out << "r=\""sv << radius_ << "\" "sv;
-    RenderAttrs(out);
-    out << "/>"sv;
+    RenderCircle(context.out, center_, radius_, GetStyle());
 }
 
 // ---------- Polyline ------------------
@@ -44,19 +285,7 @@ Polyline& Polyline::AddPoint(Point point) {
 }
 
 void Polyline::RenderObject(const RenderContext& context) const {
-    auto& out = context.out;
-
-    out << "<polyline points=\""sv;
-    for (auto it = points_.cbegin(); it != points_.cend(); ++it) {
-        if (it != points_.cbegin()) {
-            out << " "sv;
-        }
-        out << (*it).x << ","sv << (*it).y;
-    }
-    out << "\" "sv;
-    
-    RenderAttrs(out);
-    out << "/>"sv;
+    RenderPolyline(context.out, points_.cbegin(), points_.cend(), GetStyle());
 }
 
 // ---------- Text ------------------
@@ -72,17 +301,17 @@ Text& Text::SetOffset(Point offset) {
 }
 
 Text& Text::SetFontSize(uint32_t size) {
-    font_.size_ = size;
+    font_.size = size;
     return *this;
 }
 
 Text& Text::SetFontFamily(std::string font_family) {
-    font_.family_ = std::move(font_family);
+    font_.family = std::move(font_family);
     return *this;
 }
 
 Text& Text::SetFontWeight(std::string font_weight) {
-    font_.weight_ = std::move(font_weight);
+    font_.weight = std::move(font_weight);
     return *this;
 }
 
@@ -92,30 +321,7 @@ Text& Text::SetData(std::string data) {
 }
 
 void Text::RenderObject(const RenderContext& context) const {
-    auto& out = context.out;
-
-    out << "<text x=\""sv << position_.x << "\" y=\""sv << position_.y << "\" "sv;
-    out << "dx=\""sv << offset_.x << "\" dy=\""sv << offset_.y << "\" "sv;
-    font_.Print(out);
-    
-    static const std::array<std::pair<char, std::string>, 5> char_escaping_from_to = {{
-        {'&', "&amp;"s},
-        {'"', "&quot;"s},
-        {'\'', "&apos;"s},
-        {'<', "&lt;"s},
-        {'>', "&gt;"s}
-    }};
-    std::string text = data_;
-    for (const auto& char_escaping_info : char_escaping_from_to) {
-        std::string::size_type start_pos = 0;
-        while ((start_pos = text.find(char_escaping_info.first, start_pos)) != std::string::npos) {
-            text.replace(start_pos, 1, char_escaping_info.second);
-            start_pos += char_escaping_info.second.size();
-        }
-    }
-
-    RenderAttrs(out);
-    out << ">"sv << text << "</text>"sv;
+    RenderText(context.out, position_, offset_, data_, font_, GetStyle());
 }
 
 // ---------- Document ------------------
@@ -125,13 +331,224 @@ void Document::AddPtr(std::unique_ptr<Object>&& obj) {
 }
 
 void Document::Render(std::ostream& out) const {
+    std::string data;
+    Render(data);
+    WriteTo(out, data);
+}
+
+void Document::Render(std::string& data) const {
+    RenderBuffer out(data);
     RenderContext render_context{out, 0, 2};
-    out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv
-        << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
+    out << DOCUMENT_HEADER;
     for (const auto& obj : objects_) {
         obj->Render(render_context);
     }
-    out << "</svg>"sv;
+    out << DOCUMENT_FOOTER;
+}
+
+// ---------- FlatDocument ------------------
+
+FlatDocument::StyleId FlatDocument::AddStyle(PathStyle style) {
+    styles_.push_back(std::move(style));
+    return static_cast<StyleId>(styles_.size() - 1);
+}
+
+FlatDocument::FontId FlatDocument::AddFont(Font font) {
+    fonts_.push_back(std::move(font));
+    return static_cast<FontId>(fonts_.size() - 1);
+}
+
+void FlatDocument::Reserve(size_t element_count, size_t point_count, size_t text_size) {
+    elements_.reserve(element_count);
+    points_.reserve(point_count);
+    texts_.reserve(text_size);
+}
+
+void FlatDocument::AddCircle(Point center, double radius, StyleId style) {
+    assert(style < styles_.size());
+    elements_.emplace_back(CircleElement{center, radius, style});
+}
+
+void FlatDocument::AddPolyline(StyleId style) {
+    assert(style < styles_.size());
+    elements_.emplace_back(PolylineElement{static_cast<uint32_t>(points_.size()), 0, style});
+}
+
+void FlatDocument::AddPoint(Point point) {
+    assert(!elements_.empty() && std::holds_alternative<PolylineElement>(elements_.back()));
+    points_.push_back(point);
+    ++std::get<PolylineElement>(elements_.back()).point_count;
+}
+
+void FlatDocument::AddText(Point position, Point offset, std::string_view data, FontId font, StyleId style) {
+    assert(font < fonts_.size() && style < styles_.size());
+    elements_.emplace_back(TextElement{position, offset, static_cast<uint32_t>(texts_.size()),
+                                       static_cast<uint32_t>(data.size()), font, style});
+    texts_.append(data);
+}
+
+size_t FlatDocument::GetElementCount() const {
+    return elements_.size();
+}
+
+void FlatDocument::Render(std::ostream& out) const {
+    std::string data;
+    Render(data);
+    WriteTo(out, data);
+}
+
+void FlatDocument::Render(std::string& data) const {
+    RenderHeader(data);
+    RenderElements(data);
+    RenderFooter(data);
+}
+
+void FlatDocument::RenderElements(std::string& data) const {
+    RenderElements(data, 0, elements_.size());
+}
+
+void FlatDocument::RenderElements(std::string& data, size_t first, size_t last) const {
+    assert(first <= last && last <= elements_.size());
+    RenderBuffer out(data);
+    for (size_t i = first; i < last; ++i) {
+        const Element& element = elements_[i];
+        // Отступ как у Document: два пробела перед каждым элементом
+        out << "  "sv;
+        if (const auto* circle = std::get_if<CircleElement>(&element)) {
+            RenderCircle(out, circle->center, circle->radius, styles_[circle->style]);
+        } else if (const auto* polyline = std::get_if<PolylineElement>(&element)) {
+            const auto first = points_.begin() + polyline->first_point;
+            RenderPolyline(out, first, first + polyline->point_count, styles_[polyline->style]);
+        } else {
+            const auto& text = std::get<TextElement>(element);
+            RenderText(out, text.position, text.offset, GetTextData(text), fonts_[text.font], styles_[text.style]);
+        }
+        out << '\n';
+    }
+}
+
+void FlatDocument::RenderHeader(std::string& data) {
+    data.append(DOCUMENT_HEADER);
+}
+
+void FlatDocument::RenderFooter(std::string& data) {
+    data.append(DOCUMENT_FOOTER);
+}
+
+std::string_view FlatDocument::GetTextData(const TextElement& text) const {
+    return std::string_view(texts_).substr(text.data_offset, text.data_size);
+}
+
+bool FlatDocument::IsLabelWithUnderlayer(const TextElement& underlayer, const TextElement& text) const {
+    const PathStyle& underlayer_style = styles_[underlayer.style];
+    const PathStyle& text_style = styles_[text.style];
+    return underlayer.position == text.position && underlayer.offset == text.offset
+        && underlayer.font == text.font && GetTextData(underlayer) == GetTextData(text)
+        && underlayer_style.stroke_color
+        && text_style.fill_color && IsOpaque(*text_style.fill_color)
+        && !text_style.stroke_color && !text_style.stroke_width
+        && !text_style.stroke_line_cap && !text_style.stroke_line_join;
+}
+
+void FlatDocument::RenderCompact(std::string& data, int precision) const {
+    precision = std::clamp(precision, 0, MAX_COMPACT_PRECISION);
+
+    // Первый проход: символы кругов и оформления, которые служат подложками подписей
+    struct CircleSymbol {
+        double radius = 0.0;
+        StyleId style = 0;
+    };
+    std::vector<CircleSymbol> symbols;
+    std::map<std::pair<double, StyleId>, uint32_t> symbol_ids;
+    // Номер символа для каждого круга по порядку
+    std::vector<uint32_t> circle_symbols;
+    std::vector<bool> underlayer_styles(styles_.size(), false);
+    for (size_t i = 0; i < elements_.size(); ++i) {
+        if (const auto* circle = std::get_if<CircleElement>(&elements_[i])) {
+            const auto [it, inserted] = symbol_ids.emplace(std::pair{circle->radius, circle->style},
+                                                           static_cast<uint32_t>(symbols.size()));
+            if (inserted) {
+                symbols.push_back({circle->radius, circle->style});
+            }
+            circle_symbols.push_back(it->second);
+        } else if (const auto* text = std::get_if<TextElement>(&elements_[i]); text && i + 1 < elements_.size()) {
+            const auto* next_text = std::get_if<TextElement>(&elements_[i + 1]);
+            if (next_text && IsLabelWithUnderlayer(*text, *next_text)) {
+                underlayer_styles[text->style] = true;
+                ++i;
+            }
+        }
+    }
+
+    RenderBuffer out(data);
+    out << DOCUMENT_HEADER;
+
+    // Классы: sN - оформление N, hN - оформление N как обводка-подложка под текстом, fN - шрифт N
+    out << "<style>"sv;
+    for (size_t i = 0; i < styles_.size(); ++i) {
+        out << ".s"sv << static_cast<unsigned>(i) << '{';
+        RenderStyleDeclarations(out, styles_[i], true);
+        out << '}';
+        if (underlayer_styles[i]) {
+            out << ".h"sv << static_cast<unsigned>(i) << '{';
+            RenderStyleDeclarations(out, styles_[i], false);
+            out << "paint-order:stroke;}"sv;
+        }
+    }
+    for (size_t i = 0; i < fonts_.size(); ++i) {
+        out << ".f"sv << static_cast<unsigned>(i) << '{';
+        RenderFontDeclarations(out, fonts_[i]);
+        out << '}';
+    }
+    out << "</style>\n"sv;
+
+    if (!symbols.empty()) {
+        out << "<defs>"sv;
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            out << "<circle id=\"c"sv << static_cast<unsigned>(i) << '"';
+            RenderFixedAttribute(out, "r"sv, symbols[i].radius, precision);
+            out << " class=\"s"sv << symbols[i].style << "\"/>"sv;
+        }
+        out << "</defs>\n"sv;
+    }
+
+    size_t circle_index = 0;
+    for (size_t i = 0; i < elements_.size(); ++i) {
+        const Element& element = elements_[i];
+        if (const auto* circle = std::get_if<CircleElement>(&element)) {
+            out << "<use href=\"#c"sv << circle_symbols[circle_index++] << '"';
+            RenderFixedAttribute(out, "x"sv, circle->center.x, precision);
+            RenderFixedAttribute(out, "y"sv, circle->center.y, precision);
+            out << "/>"sv;
+        } else if (const auto* polyline = std::get_if<PolylineElement>(&element)) {
+            out << "<path class=\"s"sv << polyline->style << "\" d=\""sv;
+            const auto first = points_.begin() + polyline->first_point;
+            RenderPathData(out, first, first + polyline->point_count, precision);
+            out << "\"/>"sv;
+        } else {
+            const auto& text = std::get<TextElement>(element);
+            out << "<text class=\"f"sv << text.font;
+            if (i + 1 < elements_.size()) {
+                const auto* next_text = std::get_if<TextElement>(&elements_[i + 1]);
+                if (next_text && IsLabelWithUnderlayer(text, *next_text)) {
+                    out << " h"sv << text.style;
+                    ++i;
+                }
+            }
+            // После пропуска подложки elements_[i] - верхний текст подписи
+            out << " s"sv << std::get<TextElement>(elements_[i]).style << '"';
+            RenderFixedAttribute(out, "x"sv, text.position.x, precision);
+            RenderFixedAttribute(out, "y"sv, text.position.y, precision);
+            RenderFixedAttribute(out, "dx"sv, text.offset.x, precision);
+            RenderFixedAttribute(out, "dy"sv, text.offset.y, precision);
+            out << '>';
+            RenderEscapedText(out, GetTextData(text));
+            out << "</text>"sv;
+        }
+        out << '\n';
+    }
+
+    out << DOCUMENT_FOOTER;
 }
 
-}  // namespace svg
\ No newline at end of file
+}  // namespace svg
@@ -1,19 +1,59 @@
 #pragma once
 
+#include <array>
 #include <cassert>
 #include <cstdint>
 #include <deque>
 #include <iostream>
 #include <memory>
 #include <optional>
+#include <span>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <variant>
+#include <vector>
 
 namespace svg {
 
 using namespace std::literals;
 
+/*
+ * Буфер вывода SVG: текст дописывается в конец непрерывной строки без сброса потока,
+ * числа форматируются std::to_chars так же, как их выводит std::ostream по умолчанию
+ * (%g, 6 значащих цифр). Строку можно переиспользовать между рендерами
+ */
+class RenderBuffer {
+public:
+    explicit RenderBuffer(std::string& data)
+        : data_(data)
+    {}
+
+    RenderBuffer& operator<<(std::string_view value) {
+        data_.append(value);
+        return *this;
+    }
+    RenderBuffer& operator<<(const std::string& value) {
+        data_.append(value);
+        return *this;
+    }
+    RenderBuffer& operator<<(const char* value) {
+        return *this << std::string_view(value);
+    }
+    RenderBuffer& operator<<(char value) {
+        data_.push_back(value);
+        return *this;
+    }
+    RenderBuffer& operator<<(double value);
+    RenderBuffer& operator<<(unsigned value);
+
+    void put(char value) {
+        data_.push_back(value);
+    }
+
+private:
+    std::string& data_;
+};
+
 struct Rgb {
     Rgb() = default;
     Rgb(uint8_t _red, uint8_t _green, uint8_t _blue)
@@ -26,7 +66,8 @@ struct Rgb {
     uint8_t green = 0;
     uint8_t blue = 0;
 };
-inline std::ostream& operator<<(std::ostream &out, Rgb val) {
+template <typename Output>
+Output& operator<<(Output& out, Rgb val) {
     out << "rgb("sv
         << unsigned(val.red)
         << ',' << unsigned(val.green)
@@ -44,7 +85,8 @@ struct Rgba : Rgb {
     
     double opacity = 1.0;
 };
-inline std::ostream& operator<<(std::ostream &out, Rgba val) {
+template <typename Output>
+Output& operator<<(Output& out, const Rgba& val) {
     out << "rgba("sv << unsigned(val.red)
         << ',' << unsigned(val.green)
         << ',' << unsigned(val.blue)
@@ -56,11 +98,12 @@ inline std::ostream& operator<<(std::ostream &out, Rgba val) {
 inline const std::string NoneColor = "none"s;
 
 using Color = std::variant<std::monostate, std::string, Rgb, Rgba>;
-inline std::ostream& operator<<(std::ostream &out, Color color) {
+template <typename Output>
+Output& operator<<(Output& out, const Color& color) {
     if (std::holds_alternative<std::monostate>(color)) {
         out << "none"sv;
     } else {
-        visit([&out](auto value) { out << value; }, color);
+        std::visit([&out](const auto& value) { out << value; }, color);
     }
     return out;
 }
@@ -70,15 +113,13 @@ enum class StrokeLineCap {
     ROUND,
     SQUARE,
 };
-inline std::ostream& operator<<(std::ostream &out, StrokeLineCap val) {
-    static const std::unordered_map<StrokeLineCap, std::string> view_info = {
-        {StrokeLineCap::BUTT, "butt"s},
-        {StrokeLineCap::ROUND, "round"s},
-        {StrokeLineCap::SQUARE, "square"s}
-    };
-    assert(view_info.count(val));
+template <typename Output>
+Output& operator<<(Output& out, StrokeLineCap val) {
+    // Порядок совпадает с порядком значений перечисления
+    static constexpr std::array<std::string_view, 3> view_info = {"butt"sv, "round"sv, "square"sv};
+    assert(static_cast<size_t>(val) < view_info.size());
 
-    out << view_info.at(val);
+    out << view_info[static_cast<size_t>(val)];
     return out;
 }
 
@@ -89,17 +130,14 @@ enum class StrokeLineJoin {
     MITER_CLIP,
     ROUND,
 };
-inline std::ostream& operator<<(std::ostream &out, StrokeLineJoin val) {
-    static const std::unordered_map<StrokeLineJoin, std::string>  view_info = {
-        {StrokeLineJoin::ARCS, "arcs"s},
-        {StrokeLineJoin::BEVEL, "bevel"s},
-        {StrokeLineJoin::MITER, "miter"s},
-        {StrokeLineJoin::MITER_CLIP, "miter-clip"s},
-        {StrokeLineJoin::ROUND, "round"s}
-    };
-    assert(view_info.count(val));
-
-    out << view_info.at(val);
+template <typename Output>
+Output& operator<<(Output& out, StrokeLineJoin val) {
+    // Порядок совпадает с порядком значений перечисления
+    static constexpr std::array<std::string_view, 5> view_info = {
+        "arcs"sv, "bevel"sv, "miter"sv, "miter-clip"sv, "round"sv};
+    assert(static_cast<size_t>(val) < view_info.size());
+
+    out << view_info[static_cast<size_t>(val)];
     return out;
 }
 
@@ -113,16 +151,38 @@ struct Point {
     double y = 0;
 };
 
+// Атрибуты оформления фигуры: fill, stroke, stroke-width, stroke-linecap, stroke-linejoin
+struct PathStyle {
+    // Выводит заданные атрибуты, каждый с ведущим пробелом
+    void Render(RenderBuffer& out) const;
+
+    std::optional<Color> fill_color;
+    std::optional<Color> stroke_color;
+    std::optional<double> stroke_width;
+    std::optional<StrokeLineCap> stroke_line_cap;
+    std::optional<StrokeLineJoin> stroke_line_join;
+};
+
+// Атрибуты шрифта текста: font-size, font-family, font-weight
+struct Font {
+    // Выводит заданные атрибуты, каждый с завершающим пробелом
+    void Render(RenderBuffer& out) const;
+
+    uint32_t size = 1;
+    std::optional<std::string> family;
+    std::optional<std::string> weight;
+};
+
 /*
  * Вспомогательная структура, хранящая контекст для вывода SVG-документа с отступами.
- * Хранит ссылку на поток вывода, текущее значение и шаг отступа при выводе элемента
+ * Хранит ссылку на буфер вывода, текущее значение и шаг отступа при выводе элемента
  */
 struct RenderContext {
-    RenderContext(std::ostream& _out)
+    RenderContext(RenderBuffer& _out)
         : out(_out) {
     }
 
-    RenderContext(std::ostream& _out, int _indent_step, int _indent = 0)
+    RenderContext(RenderBuffer& _out, int _indent_step, int _indent = 0)
         : out(_out)
         , indent_step(_indent_step)
         , indent(_indent) {
@@ -138,7 +198,7 @@ struct RenderContext {
         }
     }
 
-    std::ostream& out;
+    RenderBuffer& out;
     int indent_step = 0;
     int indent = 0;
 };
@@ -188,46 +248,31 @@ template <typename Owner>
 class PathProps {
 public:
     Owner& SetFillColor(Color color) {
-        fill_color_ = std::move(color);
+        style_.fill_color = std::move(color);
         return AsOwner();
     }
     Owner& SetStrokeColor(Color color) {
-        stroke_color_ = std::move(color);
+        style_.stroke_color = std::move(color);
         return AsOwner();
     }
     Owner& SetStrokeWidth(double width) {
-        stroke_width_ = width;
+        style_.stroke_width = width;
         return AsOwner();
     }
     Owner& SetStrokeLineCap(StrokeLineCap line_cap) {
-        stroke_line_cap_ = line_cap;
+        style_.stroke_line_cap = line_cap;
         return AsOwner();
     }
     Owner& SetStrokeLineJoin(StrokeLineJoin line_join) {
-        stroke_line_join_ = line_join;
+        style_.stroke_line_join = line_join;
         return AsOwner();
     }    
 
 protected:
     ~PathProps() = default;
 
-    // Метод RenderAttrs выводит в поток общие для всех атрибуты
-    void RenderAttrs(std::ostream& out) const {
-        if (fill_color_) {
-            out << " fill=\""sv << *fill_color_ << "\""sv;
-        }
-        if (stroke_color_) {
-            out << " stroke=\""sv << *stroke_color_ << "\""sv;
-        }
-        if (stroke_width_) {
-            out << " stroke-width=\""sv << *stroke_width_ << "\""sv;
-        }
-        if (stroke_line_cap_) {
-            out << " stroke-linecap=\""sv << *stroke_line_cap_ << "\""sv;
-        }
-        if (stroke_line_join_) {
-            out << " stroke-linejoin=\""sv << *stroke_line_join_ << "\""sv;
-        }
+    const PathStyle& GetStyle() const {
+        return style_;
     }
 
 private:
@@ -237,11 +282,7 @@ private:
         return static_cast<Owner&>(*this);
     }
 
-    std::optional<Color> fill_color_;
-    std::optional<Color> stroke_color_;
-    std::optional<double> stroke_width_;
-    std::optional<StrokeLineCap> stroke_line_cap_;
-    std::optional<StrokeLineJoin> stroke_line_join_;
+    PathStyle style_;
 };
 
 /*
@@ -302,23 +343,6 @@ public:
 private:
     void RenderObject(const RenderContext& context) const override;
 
-private:
-    struct Font {
-        void Print(std::ostream& out) const {
-            out << "font-size=\""sv << size_<< "\" "sv;
-            if (family_) {
-                out << "font-family=\""sv << *family_ << "\" "sv;
-            }
-            if (weight_) {
-                out << "font-weight=\""sv << *weight_ << "\" "sv;
-            }
-        }
-
-        uint32_t size_ = 1;
-        std::optional<std::string> family_;
-        std::optional<std::string> weight_;
-    };
-
 private:
     std::string data_;
     Font font_;
@@ -331,11 +355,138 @@ public:
     // Добавляет в svg-документ объект-наследник svg::Object
     void AddPtr(std::unique_ptr<Object>&& obj) override;
 
-    // Выводит в ostream svg-представление документа
+    // Выводит в ostream svg-представление документа (одной записью)
     void Render(std::ostream& out) const;
 
+    // Дописывает svg-представление документа в конец строки
+    void Render(std::string& out) const;
+
 private:
     std::deque<std::unique_ptr<Object>> objects_;
 };
 
+/*
+ * Документ без объектов в куче: элементы хранятся значениями в одном векторе,
+ * оформление и шрифты - общими записями, на которые элементы ссылаются по номеру,
+ * точки ломаных и тексты - в общих пулах. После Reserve построение документа
+ * не выделяет память. Выводит тот же SVG, что и Document с такими же элементами
+ */
+class FlatDocument {
+public:
+    using StyleId = uint32_t;
+    using FontId = uint32_t;
+
+    StyleId AddStyle(PathStyle style);
+    FontId AddFont(Font font);
+
+    // Резервирует место под элементы, точки ломаных и символы текстов
+    void Reserve(size_t element_count, size_t point_count, size_t text_size);
+
+    void AddCircle(Point center, double radius, StyleId style);
+
+    // Начинает новую ломаную; вершины добавляются AddPoint
+    void AddPolyline(StyleId style);
+    // Добавляет вершину к последней начатой ломаной
+    void AddPoint(Point point);
+
+    void AddText(Point position, Point offset, std::string_view data, FontId font, StyleId style);
+
+    size_t GetElementCount() const;
+
+    // Выводит в ostream svg-представление документа (одной записью)
+    void Render(std::ostream& out) const;
+
+    // Дописывает svg-представление документа в конец строки
+    void Render(std::string& out) const;
+
+    // Дописывает только элементы, без заголовка и закрывающего тега:
+    // документ можно собрать из независимо отрендеренных фрагментов между RenderHeader и RenderFooter
+    void RenderElements(std::string& out) const;
+    // Дописывает элементы с номерами [first, last) в порядке добавления
+    void RenderElements(std::string& out, size_t first, size_t last) const;
+    static void RenderHeader(std::string& out);
+    static void RenderFooter(std::string& out);
+
+    /*
+     * Дописывает компактное svg-представление документа, изображение то же:
+     * - оформление и шрифты - классами CSS в общем блоке <style>;
+     * - круги одного радиуса и оформления - <use> одного символа из <defs>;
+     * - подпись с подложкой (два текста, отличающиеся только оформлением) - один <text>,
+     *   у которого подложка нарисована обводкой под заливкой (paint-order: stroke);
+     * - ломаные - <path> с относительными координатами.
+     * Координаты округляются до precision знаков после запятой (от 0 до MAX_COMPACT_PRECISION)
+     */
+    void RenderCompact(std::string& out, int precision) const;
+
+    static constexpr int MAX_COMPACT_PRECISION = 6;
+
+    // Элементы документа для обхода VisitElements; ссылки действительны, пока документ не меняется
+    struct CircleView {
+        Point center;
+        double radius = 1.0;
+        const PathStyle& style;
+    };
+    struct PolylineView {
+        std::span<const Point> points;
+        const PathStyle& style;
+    };
+    struct TextView {
+        Point position;
+        Point offset;
+        std::string_view data;
+        const Font& font;
+        const PathStyle& style;
+    };
+
+    // Вызывает visitor для каждого элемента в порядке вывода с CircleView, PolylineView или TextView
+    template <typename Visitor>
+    void VisitElements(Visitor&& visitor) const;
+
+private:
+    struct CircleElement {
+        Point center;
+        double radius = 1.0;
+        StyleId style = 0;
+    };
+    struct PolylineElement {
+        uint32_t first_point = 0;
+        uint32_t point_count = 0;
+        StyleId style = 0;
+    };
+    struct TextElement {
+        Point position;
+        Point offset;
+        uint32_t data_offset = 0;
+        uint32_t data_size = 0;
+        FontId font = 0;
+        StyleId style = 0;
+    };
+    using Element = std::variant<CircleElement, PolylineElement, TextElement>;
+
+    std::string_view GetTextData(const TextElement& text) const;
+    // Можно ли вывести пару текстов одним элементом: text рисуется поверх underlayer
+    bool IsLabelWithUnderlayer(const TextElement& underlayer, const TextElement& text) const;
+
+    std::vector<Element> elements_;
+    std::vector<Point> points_;
+    std::string texts_;
+    std::vector<PathStyle> styles_;
+    std::vector<Font> fonts_;
+};
+
+template <typename Visitor>
+void FlatDocument::VisitElements(Visitor&& visitor) const {
+    for (const auto& element : elements_) {
+        if (const auto* circle = std::get_if<CircleElement>(&element)) {
+            visitor(CircleView{circle->center, circle->radius, styles_[circle->style]});
+        } else if (const auto* polyline = std::get_if<PolylineElement>(&element)) {
+            visitor(PolylineView{std::span<const Point>(points_).subspan(polyline->first_point, polyline->point_count),
+                                 styles_[polyline->style]});
+        } else {
+            const auto& text = std::get<TextElement>(element);
+            visitor(TextView{text.position, text.offset, GetTextData(text), fonts_[text.font], styles_[text.style]});
+        }
+    }
+}
+
 }  // namespace svg
\ No newline at end of file
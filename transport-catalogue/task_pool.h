@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+/*
+ * Выполняет task(i) для всех i из [0, task_count) в thread_count потоках (вызывающий поток
+ * работает наравне с остальными): каждый поток берёт следующую свободную задачу.
+ * Исключение задачи пробрасывается после завершения всех потоков
+ */
+template <typename Task>
+void RunTasks(size_t thread_count, size_t task_count, const Task& task) {
+    std::vector<std::exception_ptr> task_errors(task_count);
+    std::atomic<size_t> next_task{0};
+    auto worker = [&]() {
+        for (size_t index = next_task++; index < task_count; index = next_task++) {
+            try {
+                task(index);
+            } catch (...) {
+                task_errors[index] = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(std::min(thread_count, task_count));
+    for (size_t i = 1; i < std::min(thread_count, task_count); ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    for (const auto& error : task_errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
@@ -0,0 +1,291 @@
+#include "city_generator.h"
+
+#include "json.h"
+#include "json_builder.h"
+#include "json_reader.h"
+#include "map_renderer.h"
+#include "png.h"
+#include "request_handler.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/*
+ * Бенчмарк основных этапов на синтетических городах разного размера:
+ * разбор JSON, наполнение каталога, построение графа маршрутов, FindRoute, GetBusStat,
+ * подготовка и рендер карты (в одном и во всех потоках, SVG и PNG), повторный рендер из кэша фрагментов
+ * после правки каталога, печать JSON и выполнение всего пакета stat_requests.
+ * Результаты печатаются в stdout в формате JSON, чтобы сравнивать прогоны между собой.
+ * Если повторный рендер разошёлся с полным, бенчмарк завершается с ошибкой.
+ *
+ * Запуск: transport_catalogue_benchmark [--sizes=100,1000,10000] [--repeat=3]
+ *                                       [--max-router-stops=2000] [--route-queries=1000]
+ *                                       [параметры generate_city, кроме --stops]
+ *
+ * Граф маршрутов хранит кратчайшие пути между всеми парами вершин (O(V^2) памяти),
+ * поэтому для городов больше --max-router-stops этапы с маршрутами пропускаются.
+ */
+
+using namespace std::literals;
+
+namespace {
+
+struct BenchmarkOptions {
+    std::vector<size_t> sizes{100, 1000, 10000};
+    size_t repeat = 3;
+    size_t max_router_stops = 2000;
+    size_t route_queries = 1000;
+    city_generator::CityParameters city;
+};
+
+struct Measurement {
+    size_t iterations = 0;
+    // Число операций в одной итерации (например, запросов FindRoute)
+    size_t operations = 1;
+    double min_us = std::numeric_limits<double>::max();
+    double total_us = 0.0;
+};
+
+// Выполняет action repeat раз и запоминает лучшее и среднее время
+template <typename Action>
+Measurement Measure(size_t repeat, size_t operations, Action action) {
+    Measurement measurement;
+    measurement.operations = std::max<size_t>(operations, 1);
+    for (size_t i = 0; i < repeat; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        action();
+        const double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        measurement.min_us = std::min(measurement.min_us, elapsed);
+        measurement.total_us += elapsed;
+        ++measurement.iterations;
+    }
+    return measurement;
+}
+
+void AddMeasurement(json::Builder& report, const std::string& name, const Measurement& measurement) {
+    const double mean_us = measurement.total_us / static_cast<double>(measurement.iterations);
+    report.Key(name).StartDict()
+              .Key("iterations").Value(static_cast<int>(measurement.iterations))
+              .Key("operations").Value(static_cast<int>(measurement.operations))
+              .Key("min_us").Value(measurement.min_us)
+              .Key("mean_us").Value(mean_us)
+              .Key("mean_per_operation_us").Value(mean_us / static_cast<double>(measurement.operations))
+          .EndDict();
+}
+
+std::vector<size_t> ParseSizes(std::string_view value) {
+    std::vector<size_t> sizes;
+    while (!value.empty()) {
+        const size_t separator = std::min(value.find(','), value.size());
+        sizes.push_back(std::stoul(std::string(value.substr(0, separator))));
+        value.remove_prefix(std::min(separator + 1, value.size()));
+    }
+    return sizes;
+}
+
+// Возвращает false, если рендер карты из кэша фрагментов разошёлся с полным рендером
+bool RunCityBenchmarks(const BenchmarkOptions& options, size_t stop_count, json::Builder& report) {
+    city_generator::CityParameters parameters = options.city;
+    parameters.stop_count = stop_count;
+    std::string input_text;
+    {
+        std::ostringstream input;
+        json::Print(city_generator::GenerateCity(parameters), input);
+        input_text = std::move(input).str();
+    }
+    const bool is_router_enabled = stop_count <= options.max_router_stops;
+
+    report.StartDict()
+              .Key("stops").Value(static_cast<int>(stop_count))
+              .Key("input_bytes").Value(static_cast<int>(input_text.size()))
+              .Key("router_enabled").Value(is_router_enabled)
+              .Key("benchmarks").StartDict();
+
+    AddMeasurement(report, "parse", Measure(options.repeat, 1, [&input_text]() {
+        std::istringstream input(input_text);
+        json::Load(input);
+    }));
+
+    std::istringstream input(input_text);
+    const json::Document doc(json::Load(input));
+
+    AddMeasurement(report, "ingest", Measure(options.repeat, 1, [&doc]() {
+        transport::TransportCatalogue db;
+        transport::FillTransportCatalogue(db, doc);
+        renderer::MapRenderer map_renderer;
+        renderer::FillMapRenderer(map_renderer, doc);
+    }));
+
+    transport::TransportCatalogue db;
+    transport::FillTransportCatalogue(db, doc);
+    renderer::MapRenderer map_renderer;
+    renderer::FillMapRenderer(map_renderer, doc);
+
+    if (is_router_enabled) {
+        AddMeasurement(report, "router_build", Measure(options.repeat, 1, [&db]() {
+            TransportRouter router(db);
+        }));
+    }
+
+    const RequestHandler request_handler(db, map_renderer,
+                                         is_router_enabled ? RouterBuildMode::IMMEDIATE : RouterBuildMode::ON_FIRST_ROUTE);
+
+    if (is_router_enabled) {
+        // Пары остановок выбираются детерминированно, одинаково для всех итераций
+        const auto stops = db.GetStops();
+        std::vector<std::pair<std::string_view, std::string_view>> route_pairs;
+        route_pairs.reserve(options.route_queries);
+        for (uint64_t i = 0, state = 1; i < options.route_queries && !stops.empty(); ++i) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            route_pairs.emplace_back(stops[(state >> 33) % stops.size()]->id,
+                                     stops[(state >> 13) % stops.size()]->id);
+        }
+        AddMeasurement(report, "find_route", Measure(options.repeat, route_pairs.size(), [&]() {
+            for (const auto& [from, to] : route_pairs) {
+                request_handler.FindRoute(from, to);
+            }
+        }));
+    }
+
+    const auto buses = db.GetBuses();
+    AddMeasurement(report, "bus_stat", Measure(options.repeat, buses.size(), [&]() {
+        for (const auto bus : buses) {
+            request_handler.GetBusStat(bus->id);
+        }
+    }));
+
+    AddMeasurement(report, "render_map", Measure(options.repeat, 1, [&request_handler]() {
+        std::ostringstream svg_out;
+        request_handler.RenderMap().Render(svg_out);
+    }));
+
+    // Подготовка карты к рендеру (один раз на каталог и настройки): индекс и проекция остановок
+    AddMeasurement(report, "map_geometry", Measure(options.repeat, 1, [&db, &map_renderer]() {
+        map_renderer.ProjectStops(std::make_shared<renderer::MapIndex>(db.GetBuses(), db.GetRoundtripBuses()));
+    }));
+
+    // Текст карты, отрендеренный кусками во всех потоках машины
+    const auto map_geometry = map_renderer.ProjectStops(std::make_shared<renderer::MapIndex>(db.GetBuses(), db.GetRoundtripBuses()));
+    map_renderer.SetThreadCount(std::thread::hardware_concurrency());
+    AddMeasurement(report, "render_map_parallel", Measure(options.repeat, 1, [&map_geometry, &map_renderer]() {
+        std::string svg;
+        map_renderer.RenderMap(map_geometry, svg);
+    }));
+    map_renderer.SetThreadCount(1);
+
+    // Та же карта в компактном SVG
+    AddMeasurement(report, "render_map_compact", Measure(options.repeat, 1, [&map_geometry, &map_renderer]() {
+        std::string svg;
+        map_renderer.RenderMap(map_geometry).RenderCompact(svg, 2);
+    }));
+
+    // Та же карта картинкой PNG: растеризация во всех потоках машины и сжатие
+    map_renderer.SetThreadCount(std::thread::hardware_concurrency());
+    AddMeasurement(report, "render_map_image", Measure(options.repeat, 1, [&map_geometry, &map_renderer]() {
+        std::string png;
+        raster::EncodePng(map_renderer.RasterizeMap(map_geometry), png);
+    }));
+    map_renderer.SetThreadCount(1);
+
+    // Правка каталога и повторный рендер из кэша фрагментов: в каждой итерации добавляются остановка
+    // между двумя существующими (проекция не меняется) и маршрут с названием раньше маршрутов города
+    // (цвета палитры сдвигаются у всех маршрутов). Правится отдельный каталог из того же документа,
+    // чтобы не менять остальные этапы. Каждый результат затем сравнивается с полным рендером
+    transport::TransportCatalogue edited_db;
+    transport::FillTransportCatalogue(edited_db, doc);
+    const auto edited_stops = edited_db.GetStops();
+    if (edited_stops.size() >= 2) {
+        renderer::MapFragmentCache fragment_cache;
+        std::vector<std::pair<renderer::MapGeometry, std::string>> edited_maps;
+        {
+            std::string svg;
+            const auto geometry = map_renderer.ProjectStops(
+                std::make_shared<renderer::MapIndex>(edited_db.GetBuses(), edited_db.GetRoundtripBuses()));
+            map_renderer.RenderMap(geometry, fragment_cache, svg);
+        }
+        AddMeasurement(report, "render_map_after_edit", Measure(options.repeat, 1, [&]() {
+            const size_t edit = edited_maps.size();
+            const auto from = edited_stops[edit % edited_stops.size()];
+            const auto to = edited_stops[(edit + 1) % edited_stops.size()];
+            const std::string stop_name = "!edit stop "s + std::to_string(edit);
+            edited_db.AddStop(stop_name, {(from->coordinates.lat + to->coordinates.lat) / 2.0,
+                                          (from->coordinates.lng + to->coordinates.lng) / 2.0});
+            edited_db.AddBus("!edit "s + std::to_string(edit), {from, edited_db.GetStop(stop_name), to}, false);
+
+            auto& [geometry, svg] = edited_maps.emplace_back();
+            geometry = map_renderer.ProjectStops(
+                std::make_shared<renderer::MapIndex>(edited_db.GetBuses(), edited_db.GetRoundtripBuses()));
+            map_renderer.RenderMap(geometry, fragment_cache, svg);
+        }));
+        for (size_t edit = 0; edit < edited_maps.size(); ++edit) {
+            std::string full_svg;
+            map_renderer.RenderMap(edited_maps[edit].first, full_svg);
+            if (edited_maps[edit].second != full_svg) {
+                std::cerr << "render_map_after_edit: incremental render differs from full render after edit "sv
+                          << edit + 1 << " (stops: "sv << stop_count << ")"sv << std::endl;
+                return false;
+            }
+        }
+    }
+
+    AddMeasurement(report, "print", Measure(options.repeat, 1, [&doc]() {
+        std::ostringstream output;
+        json::Print(doc, output);
+    }));
+
+    if (is_router_enabled) {
+        AddMeasurement(report, "stat_requests", Measure(options.repeat, parameters.stat_request_count, [&]() {
+            std::ostringstream output;
+            transport::ExecuteStatRequests(request_handler, doc, output);
+        }));
+    }
+
+    report.EndDict().EndDict();
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view argument(argv[i]);
+        const std::string value(argument.substr(std::min(argument.find('=') + 1, argument.size())));
+        if (argument.substr(0, "--sizes="sv.size()) == "--sizes="sv) {
+            options.sizes = ParseSizes(value);
+        } else if (argument.substr(0, "--repeat="sv.size()) == "--repeat="sv) {
+            options.repeat = std::max<size_t>(1, std::stoul(value));
+        } else if (argument.substr(0, "--max-router-stops="sv.size()) == "--max-router-stops="sv) {
+            options.max_router_stops = std::stoul(value);
+        } else if (argument.substr(0, "--route-queries="sv.size()) == "--route-queries="sv) {
+            options.route_queries = std::stoul(value);
+        } else if (!city_generator::ParseCityParameter(argument, options.city)) {
+            std::cerr << "Unknown argument: "sv << argument << std::endl;
+            return 1;
+        }
+    }
+
+    json::Builder report;
+    report.StartDict()
+              .Key("repeat").Value(static_cast<int>(options.repeat))
+              .Key("seed").Value(static_cast<int>(options.city.seed))
+              .Key("cities").StartArray();
+    for (size_t stop_count : options.sizes) {
+        if (!RunCityBenchmarks(options, stop_count, report)) {
+            return 1;
+        }
+    }
+    json::Print(json::Document(report.EndArray().EndDict().Build()), std::cout);
+    std::cout << std::endl;
+    return 0;
+}
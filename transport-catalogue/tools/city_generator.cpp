@@ -0,0 +1,298 @@
+#include "city_generator.h"
+
+#include "geo.h"
+#include "json_builder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using namespace std::literals;
+
+namespace city_generator {
+
+namespace {
+
+// Размеры города в градусах
+constexpr double MIN_LATITUDE = 55.55;
+constexpr double MIN_LONGITUDE = 37.35;
+constexpr double CITY_SIZE = 0.4;
+
+// Соседние перекрёстки сетки: сначала по улицам, затем по диагоналям
+constexpr std::pair<int, int> NEIGHBOR_SHIFTS[] = {
+    {0, 1}, {1, 0}, {0, -1}, {-1, 0}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+
+// Случайные числа: std::mt19937_64 одинаков на всех платформах, а распределения стандартной
+// библиотеки - нет, поэтому числа из диапазона получаем сами
+class Random {
+public:
+    explicit Random(uint64_t seed)
+        : engine_(seed)
+    {}
+
+    size_t Index(size_t size) {
+        return static_cast<size_t>(engine_() % size);
+    }
+
+    size_t Between(size_t min, size_t max) {
+        return min + Index(max - min + 1);
+    }
+
+    double Real() {
+        return static_cast<double>(engine_() >> 11) * 0x1.0p-53;
+    }
+
+private:
+    std::mt19937_64 engine_;
+};
+
+class CityBuilder {
+public:
+    CityBuilder(const CityParameters& parameters)
+        : parameters_(parameters)
+        , random_(parameters.seed)
+        , side_(static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(std::max<size_t>(parameters.stop_count, 1))))))
+        , road_distances_(parameters.stop_count)
+    {}
+
+    json::Document Build() {
+        PlaceStops();
+        PlaceBuses();
+        AddNeighborDistances();
+
+        json::Builder doc;
+        doc.StartDict().Key("base_requests").StartArray();
+        for (size_t stop = 0; stop < parameters_.stop_count; ++stop) {
+            doc.StartDict()
+                   .Key("type").Value("Stop"s)
+                   .Key("name").Value(StopName(stop))
+                   .Key("latitude").Value(coordinates_[stop].lat)
+                   .Key("longitude").Value(coordinates_[stop].lng)
+                   .Key("road_distances").StartDict();
+            for (const auto& [to, distance] : road_distances_[stop]) {
+                doc.Key(StopName(to)).Value(distance);
+            }
+            doc.EndDict().EndDict();
+        }
+        for (size_t bus = 0; bus < buses_.size(); ++bus) {
+            doc.StartDict()
+                   .Key("type").Value("Bus"s)
+                   .Key("name").Value(BusName(bus))
+                   .Key("is_roundtrip").Value(buses_[bus].is_roundtrip)
+                   .Key("stops").StartArray();
+            for (size_t stop : buses_[bus].stops) {
+                doc.Value(StopName(stop));
+            }
+            doc.EndArray().EndDict();
+        }
+        doc.EndArray();
+
+        AddSettings(doc);
+        AddStatRequests(doc);
+        return json::Document(doc.EndDict().Build());
+    }
+
+private:
+    struct BusRoute {
+        std::vector<size_t> stops;
+        bool is_roundtrip = false;
+    };
+
+    static std::string StopName(size_t stop) {
+        return "Stop "s + std::to_string(stop);
+    }
+
+    static std::string BusName(size_t bus) {
+        return std::to_string(bus);
+    }
+
+    // Остановка на перекрёстке сетки со случайным сдвигом в пределах квартала
+    void PlaceStops() {
+        const double step = CITY_SIZE / static_cast<double>(side_);
+        coordinates_.reserve(parameters_.stop_count);
+        for (size_t stop = 0; stop < parameters_.stop_count; ++stop) {
+            const double row = static_cast<double>(stop / side_) + (random_.Real() - 0.5) * 0.5;
+            const double column = static_cast<double>(stop % side_) + (random_.Real() - 0.5) * 0.5;
+            coordinates_.push_back({MIN_LATITUDE + row * step, MIN_LONGITUDE + column * step});
+        }
+    }
+
+    // Возвращает соседнюю по сетке остановку или stop, если соседа нет
+    size_t GetNeighbor(size_t stop, size_t shift_index) const {
+        const auto [row_shift, column_shift] = NEIGHBOR_SHIFTS[shift_index];
+        const long long row = static_cast<long long>(stop / side_) + row_shift;
+        const long long column = static_cast<long long>(stop % side_) + column_shift;
+        if (row < 0 || column < 0 || column >= static_cast<long long>(side_)) {
+            return stop;
+        }
+        const size_t neighbor = static_cast<size_t>(row) * side_ + static_cast<size_t>(column);
+        return neighbor < parameters_.stop_count ? neighbor : stop;
+    }
+
+    // Маршрут - случайное блуждание по улицам без немедленного возврата назад
+    void PlaceBuses() {
+        if (parameters_.stop_count < 2) {
+            return;
+        }
+        const size_t bus_count = parameters_.bus_count != 0
+                                 ? parameters_.bus_count
+                                 : std::max<size_t>(1, parameters_.stop_count / 10);
+        const size_t min_length = std::max<size_t>(2, parameters_.min_route_length);
+        const size_t max_length = std::max(min_length, parameters_.max_route_length);
+        buses_.reserve(bus_count);
+        for (size_t bus = 0; bus < bus_count; ++bus) {
+            BusRoute route;
+            route.is_roundtrip = random_.Real() < parameters_.roundtrip_ratio;
+            const size_t length = random_.Between(min_length, max_length);
+            route.stops.push_back(random_.Index(parameters_.stop_count));
+            while (route.stops.size() < length) {
+                const size_t current = route.stops.back();
+                const size_t previous = route.stops.size() > 1 ? route.stops[route.stops.size() - 2] : current;
+                size_t next = current;
+                for (size_t attempt = 0; attempt < 8 && (next == current || next == previous); ++attempt) {
+                    next = GetNeighbor(current, random_.Index(4));
+                }
+                if (next == current) {
+                    next = (current + 1) % parameters_.stop_count;
+                }
+                AddDistance(current, next);
+                route.stops.push_back(next);
+            }
+            if (route.is_roundtrip && route.stops.back() != route.stops.front()) {
+                AddDistance(route.stops.back(), route.stops.front());
+                route.stops.push_back(route.stops.front());
+            }
+            buses_.push_back(std::move(route));
+        }
+    }
+
+    void AddNeighborDistances() {
+        const size_t count = std::min<size_t>(parameters_.distances_per_stop, std::size(NEIGHBOR_SHIFTS));
+        for (size_t stop = 0; stop < parameters_.stop_count; ++stop) {
+            for (size_t shift_index = 0; shift_index < count; ++shift_index) {
+                const size_t neighbor = GetNeighbor(stop, shift_index);
+                if (neighbor != stop) {
+                    AddDistance(stop, neighbor);
+                }
+            }
+        }
+    }
+
+    // Дорога длиннее прямой на 10-50%; расстояние в обратную сторону не задаётся
+    void AddDistance(size_t from, size_t to) {
+        if (from == to || !known_distances_.insert(from * parameters_.stop_count + to).second) {
+            return;
+        }
+        const double straight = geo::ComputeDistance(coordinates_[from], coordinates_[to]);
+        const int distance = std::max(1, static_cast<int>(straight * (1.1 + 0.4 * random_.Real())));
+        road_distances_[from].emplace_back(to, distance);
+    }
+
+    void AddSettings(json::Builder& doc) const {
+        doc.Key("render_settings").StartDict()
+               .Key("width").Value(1200.0)
+               .Key("height").Value(1200.0)
+               .Key("padding").Value(50.0)
+               .Key("line_width").Value(14.0)
+               .Key("stop_radius").Value(5.0)
+               .Key("bus_label_font_size").Value(20)
+               .Key("bus_label_offset").StartArray().Value(7.0).Value(15.0).EndArray()
+               .Key("stop_label_font_size").Value(18)
+               .Key("stop_label_offset").StartArray().Value(7.0).Value(-3.0).EndArray()
+               .Key("underlayer_color").StartArray().Value(255).Value(255).Value(255).Value(0.85).EndArray()
+               .Key("underlayer_width").Value(3.0)
+               .Key("color_palette").StartArray()
+                   .Value("green"s)
+                   .StartArray().Value(255).Value(160).Value(0).EndArray()
+                   .Value("red"s)
+               .EndArray()
+           .EndDict();
+        doc.Key("routing_settings").StartDict()
+               .Key("bus_wait_time").Value(6)
+               .Key("bus_velocity").Value(40.0)
+           .EndDict();
+    }
+
+    // Запросы Bus, Stop и Route примерно поровну, запросы Map - в конце
+    void AddStatRequests(json::Builder& doc) {
+        doc.Key("stat_requests").StartArray();
+        int id = 1;
+        if (parameters_.stop_count != 0) {
+            for (size_t i = 0; i < parameters_.stat_request_count; ++i, ++id) {
+                doc.StartDict().Key("id").Value(id);
+                switch (random_.Index(3)) {
+                case 0:
+                    if (!buses_.empty()) {
+                        doc.Key("type").Value("Bus"s).Key("name").Value(BusName(random_.Index(buses_.size())));
+                        break;
+                    }
+                    [[fallthrough]];
+                case 1:
+                    doc.Key("type").Value("Stop"s).Key("name").Value(StopName(random_.Index(parameters_.stop_count)));
+                    break;
+                default:
+                    doc.Key("type").Value("Route"s)
+                       .Key("from").Value(StopName(random_.Index(parameters_.stop_count)))
+                       .Key("to").Value(StopName(random_.Index(parameters_.stop_count)));
+                    break;
+                }
+                doc.EndDict();
+            }
+        }
+        for (size_t i = 0; i < parameters_.map_request_count; ++i, ++id) {
+            doc.StartDict().Key("id").Value(id).Key("type").Value("Map"s).EndDict();
+        }
+        doc.EndArray();
+    }
+
+    const CityParameters& parameters_;
+    Random random_;
+    const size_t side_;
+    std::vector<geo::Coordinates> coordinates_;
+    std::vector<std::vector<std::pair<size_t, int>>> road_distances_;
+    std::unordered_set<size_t> known_distances_;
+    std::vector<BusRoute> buses_;
+};
+
+}  // namespace
+
+json::Document GenerateCity(const CityParameters& parameters) {
+    return CityBuilder(parameters).Build();
+}
+
+bool ParseCityParameter(std::string_view argument, CityParameters& parameters) {
+    const size_t separator = argument.find('=');
+    if (separator == std::string_view::npos) {
+        return false;
+    }
+    const std::string_view name = argument.substr(0, separator);
+    const std::string value(argument.substr(separator + 1));
+    if (name == "--stops"sv) {
+        parameters.stop_count = std::stoul(value);
+    } else if (name == "--buses"sv) {
+        parameters.bus_count = std::stoul(value);
+    } else if (name == "--min-route"sv) {
+        parameters.min_route_length = std::stoul(value);
+    } else if (name == "--max-route"sv) {
+        parameters.max_route_length = std::stoul(value);
+    } else if (name == "--roundtrip-ratio"sv) {
+        parameters.roundtrip_ratio = std::stod(value);
+    } else if (name == "--distances-per-stop"sv) {
+        parameters.distances_per_stop = std::stoul(value);
+    } else if (name == "--stat-requests"sv) {
+        parameters.stat_request_count = std::stoul(value);
+    } else if (name == "--map-requests"sv) {
+        parameters.map_request_count = std::stoul(value);
+    } else if (name == "--seed"sv) {
+        parameters.seed = std::stoull(value);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+}  // namespace city_generator
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "json.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/*
+ * Детерминированный генератор синтетических городов для бенчмарков.
+ * Остановки раскладываются по сетке улиц, маршруты идут по соседним перекрёсткам,
+ * поэтому сеть связная и похожа на настоящую. Одинаковые параметры дают одинаковый документ.
+ */
+
+namespace city_generator {
+
+struct CityParameters {
+    size_t stop_count = 1000;
+    // 0 - по одному маршруту на каждые 10 остановок
+    size_t bus_count = 0;
+    // Число остановок в описании маршрута (для кольцевых - без повторной конечной)
+    size_t min_route_length = 4;
+    size_t max_route_length = 20;
+    // Доля кольцевых маршрутов
+    double roundtrip_ratio = 0.5;
+    // Сколько дополнительных дорожных расстояний до соседей задаёт каждая остановка (до 8)
+    size_t distances_per_stop = 2;
+    size_t stat_request_count = 1000;
+    size_t map_request_count = 1;
+    uint64_t seed = 1;
+};
+
+// Возвращает входной документ (base_requests, render_settings, routing_settings, stat_requests)
+json::Document GenerateCity(const CityParameters& parameters);
+
+// Разбирает параметр командной строки вида --stops=1000 (--buses, --min-route, --max-route,
+// --roundtrip-ratio, --distances-per-stop, --stat-requests, --map-requests, --seed).
+// Возвращает false, если это не параметр генератора
+bool ParseCityParameter(std::string_view argument, CityParameters& parameters);
+
+}  // namespace city_generator
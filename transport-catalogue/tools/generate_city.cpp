@@ -0,0 +1,27 @@
+#include "city_generator.h"
+
+#include <iostream>
+#include <string_view>
+
+/*
+ * Печатает в stdout входной документ синтетического города.
+ *
+ * Запуск: generate_city [--stops=1000] [--buses=0] [--min-route=4] [--max-route=20]
+ *                       [--roundtrip-ratio=0.5] [--distances-per-stop=2]
+ *                       [--stat-requests=1000] [--map-requests=1] [--seed=1]
+ */
+
+using namespace std::literals;
+
+int main(int argc, char* argv[]) {
+    city_generator::CityParameters parameters;
+    for (int i = 1; i < argc; ++i) {
+        if (!city_generator::ParseCityParameter(argv[i], parameters)) {
+            std::cerr << "Unknown argument: "sv << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    json::Print(city_generator::GenerateCity(parameters), std::cout);
+    std::cout << std::endl;
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * Нагрузочный клиент сервера запросов (transport_catalogue --socket=<path>).
+ * Открывает несколько соединений, в каждом по очереди отправляет запросы из файла NDJSON
+ * и ждёт ответа на каждый, затем выводит пропускную способность и перцентили задержки.
+ *
+ * Запуск: query_load_test <socket path> <requests.ndjson> [connections=4] [requests=10000]
+ */
+
+using namespace std::literals;
+
+namespace {
+
+int Connect(const std::string& socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        throw std::runtime_error("connect to "s + socket_path + " failed");
+    }
+    return fd;
+}
+
+bool SendAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        const ssize_t size = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (size <= 0) {
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(size));
+    }
+    return true;
+}
+
+// Читает из сокета до конца очередной строки ответа, остаток сохраняет в buffer
+bool ReceiveLine(int fd, std::string& buffer) {
+    size_t line_end;
+    while ((line_end = buffer.find('\n')) == std::string::npos) {
+        char chunk[1 << 16];
+        const ssize_t size = recv(fd, chunk, sizeof(chunk), 0);
+        if (size <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(size));
+    }
+    buffer.erase(0, line_end + 1);
+    return true;
+}
+
+double Percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const auto index = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1));
+    return sorted[index];
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: "sv << argv[0] << " <socket path> <requests.ndjson> [connections] [requests]"sv << std::endl;
+        return 1;
+    }
+    const std::string socket_path = argv[1];
+    const size_t connection_count = argc > 3 ? std::stoul(argv[3]) : 4;
+    const size_t request_count = argc > 4 ? std::stoul(argv[4]) : 10000;
+
+    std::vector<std::string> requests;
+    std::ifstream requests_file(argv[2]);
+    for (std::string line; std::getline(requests_file, line);) {
+        if (!line.empty()) {
+            requests.push_back(line + '\n');
+        }
+    }
+    if (requests.empty()) {
+        std::cerr << "No requests in "sv << argv[2] << std::endl;
+        return 1;
+    }
+
+    std::vector<std::vector<double>> latencies(connection_count);
+    std::atomic<size_t> next_request{0};
+    std::atomic<size_t> failed_count{0};
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (size_t client = 0; client < connection_count; ++client) {
+        clients.emplace_back([&, client]() {
+            const int fd = Connect(socket_path);
+            std::string buffer;
+            for (size_t i = next_request++; i < request_count; i = next_request++) {
+                const auto sent = std::chrono::steady_clock::now();
+                if (!SendAll(fd, requests[i % requests.size()]) || !ReceiveLine(fd, buffer)) {
+                    ++failed_count;
+                    break;
+                }
+                latencies[client].push_back(
+                    std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent).count());
+            }
+            close(fd);
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> all_latencies;
+    for (const auto& client_latencies : latencies) {
+        all_latencies.insert(all_latencies.end(), client_latencies.begin(), client_latencies.end());
+    }
+    std::sort(all_latencies.begin(), all_latencies.end());
+
+    std::cout << "{\"requests\":"sv << all_latencies.size()
+              << ",\"failed_connections\":"sv << failed_count.load()
+              << ",\"seconds\":"sv << seconds
+              << ",\"qps\":"sv << static_cast<double>(all_latencies.size()) / seconds
+              << ",\"p50_us\":"sv << Percentile(all_latencies, 0.5)
+              << ",\"p90_us\":"sv << Percentile(all_latencies, 0.9)
+              << ",\"p99_us\":"sv << Percentile(all_latencies, 0.99)
+              << ",\"p999_us\":"sv << Percentile(all_latencies, 0.999)
+              << ",\"max_us\":"sv << (all_latencies.empty() ? 0.0 : all_latencies.back())
+              << '}' << std::endl;
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "tracing.h"
+
+#include "json.h"
+
+#include <iomanip>
+
+namespace tracing {
+
+Tracer::Tracer()
+    : start_(std::chrono::steady_clock::now())
+{}
+
+Tracer& Tracer::Instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::Enable() {
+    is_enabled_.store(true, std::memory_order_relaxed);
+}
+
+Tracer::ThreadBuffer& Tracer::GetThreadBuffer() {
+    // Буфер берётся при первом событии потока и возвращается при завершении потока: пулы,
+    // которые создают потоки на каждый пакет запросов, переиспользуют одни и те же буферы.
+    // Передача буфера идёт под buffers_mutex_, поэтому новый владелец видит всё, что записал прежний
+    struct ThreadBufferLease {
+        ThreadBuffer* buffer = nullptr;
+        ~ThreadBufferLease() {
+            if (buffer) {
+                Tracer::Instance().ReleaseThreadBuffer(*buffer);
+            }
+        }
+    };
+    thread_local ThreadBufferLease lease;
+    if (!lease.buffer) {
+        std::lock_guard lock(buffers_mutex_);
+        if (!free_buffers_.empty()) {
+            lease.buffer = free_buffers_.back();
+            free_buffers_.pop_back();
+        } else {
+            lease.buffer = buffers_.emplace_back(std::make_unique<ThreadBuffer>(static_cast<uint32_t>(buffers_.size() + 1))).get();
+        }
+    }
+    return *lease.buffer;
+}
+
+void Tracer::ReleaseThreadBuffer(ThreadBuffer& buffer) {
+    std::lock_guard lock(buffers_mutex_);
+    free_buffers_.push_back(&buffer);
+}
+
+void Tracer::Record(const Event& event) {
+    ThreadBuffer& buffer = GetThreadBuffer();
+    const uint64_t written = buffer.written.load(std::memory_order_relaxed);
+    buffer.events[written % THREAD_BUFFER_CAPACITY] = event;
+    buffer.written.store(written + 1, std::memory_order_release);
+}
+
+void Tracer::WriteChromeTrace(std::ostream& output) const {
+    std::lock_guard lock(buffers_mutex_);
+    const auto flags = output.flags();
+    const auto precision = output.precision();
+    output << std::fixed << std::setprecision(3);
+
+    // Время в микросекундах; события типа "X" (complete) содержат и начало, и длительность
+    output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool is_first = true;
+    for (const auto& buffer : buffers_) {
+        const uint64_t written = buffer->written.load(std::memory_order_acquire);
+        const uint64_t first = written > THREAD_BUFFER_CAPACITY ? written - THREAD_BUFFER_CAPACITY : 0;
+        for (uint64_t index = first; index < written; ++index) {
+            const Event& event = buffer->events[index % THREAD_BUFFER_CAPACITY];
+            output << (is_first ? "" : ",") << "\n{\"name\":\"";
+            is_first = false;
+            json::PrintEscapedString(event.name, output);
+            output << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_id
+                   << ",\"ts\":" << static_cast<double>(event.begin_ns) / 1000.0
+                   << ",\"dur\":" << static_cast<double>(event.end_ns - event.begin_ns) / 1000.0;
+            if (event.arg != NO_ARG) {
+                output << ",\"args\":{\"id\":" << event.arg << '}';
+            }
+            output << '}';
+        }
+    }
+    output << "\n]}\n";
+
+    output.flags(flags);
+    output.precision(precision);
+}
+
+}  // namespace tracing
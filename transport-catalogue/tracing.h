@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+/*
+ * Трассировка этапов и запросов для просмотра временной шкалы в Perfetto / chrome://tracing.
+ *
+ * Каждый поток пишет события в свой кольцевой буфер без блокировок (при переполнении
+ * затираются самые старые события), при выходе буферы выгружаются в формате Chrome trace_event.
+ * Завершившийся поток возвращает буфер трассировщику, и его получает следующий новый поток:
+ * буферов столько, сколько потоков писало события одновременно, а не сколько их было создано.
+ * Потоки с общим буфером показываются на временной шкале одной дорожкой.
+ * Пока трассировка не включена, область TC_TRACE_SCOPE стоит одну атомарную загрузку.
+ * Как и таймеры этапов, макросы отключаются при сборке с TC_INSTRUMENTATION=0.
+ */
+
+namespace tracing {
+
+// Завершённый интервал: начало и конец в наносекундах от запуска трассировщика.
+// name должен указывать на строку со статическим временем жизни (строковый литерал)
+struct Event {
+    std::string_view name;
+    int64_t begin_ns = 0;
+    int64_t end_ns = 0;
+    // Необязательный числовой аргумент (например, id запроса), NO_ARG - нет аргумента
+    int64_t arg = 0;
+};
+
+class Tracer {
+public:
+    static constexpr int64_t NO_ARG = INT64_MIN;
+    // Ёмкость кольцевого буфера одного потока (событий)
+    static constexpr size_t THREAD_BUFFER_CAPACITY = size_t{1} << 15;
+
+    static Tracer& Instance();
+
+    void Enable();
+    bool IsEnabled() const {
+        return is_enabled_.load(std::memory_order_relaxed);
+    }
+
+    int64_t Now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    // Добавляет событие в буфер текущего потока
+    void Record(const Event& event);
+
+    // Печатает все события в формате JSON Chrome trace_event. Вызывается, когда потоки,
+    // пишущие события, уже завершили работу
+    void WriteChromeTrace(std::ostream& output) const;
+
+private:
+    // Кольцевой буфер: пишет только поток-владелец, читает WriteChromeTrace
+    struct ThreadBuffer {
+        explicit ThreadBuffer(uint32_t thread_id)
+            : thread_id(thread_id)
+            , events(THREAD_BUFFER_CAPACITY)
+        {}
+
+        const uint32_t thread_id;
+        std::vector<Event> events;
+        std::atomic<uint64_t> written{0};
+    };
+
+    Tracer();
+
+    ThreadBuffer& GetThreadBuffer();
+    // Возвращает буфер завершившегося потока в список свободных
+    void ReleaseThreadBuffer(ThreadBuffer& buffer);
+
+    const std::chrono::steady_clock::time_point start_;
+    std::atomic<bool> is_enabled_{false};
+
+    mutable std::mutex buffers_mutex_;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+    std::vector<ThreadBuffer*> free_buffers_;
+};
+
+// Записывает интервал от создания до разрушения объекта, если трассировка включена
+class ScopedTrace {
+public:
+    explicit ScopedTrace(std::string_view name, int64_t arg = Tracer::NO_ARG)
+        : name_(name)
+        , arg_(arg)
+        , begin_ns_(Tracer::Instance().IsEnabled() ? Tracer::Instance().Now() : -1)
+    {}
+
+    ~ScopedTrace() {
+        if (begin_ns_ >= 0) {
+            Tracer::Instance().Record(Event{name_, begin_ns_, Tracer::Instance().Now(), arg_});
+        }
+    }
+
+    ScopedTrace(const ScopedTrace&) = delete;
+    ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+private:
+    std::string_view name_;
+    int64_t arg_;
+    int64_t begin_ns_;
+};
+
+}  // namespace tracing
+
+#ifndef TC_INSTRUMENTATION
+#define TC_INSTRUMENTATION 1
+#endif
+
+#define TC_TRACING_CONCAT_IMPL(a, b) a##b
+#define TC_TRACING_CONCAT(a, b) TC_TRACING_CONCAT_IMPL(a, b)
+
+#if TC_INSTRUMENTATION
+#define TC_TRACE_SCOPE(name) ::tracing::ScopedTrace TC_TRACING_CONCAT(tc_scoped_trace_, __LINE__)(name)
+#define TC_TRACE_SCOPE_ARG(name, arg) ::tracing::ScopedTrace TC_TRACING_CONCAT(tc_scoped_trace_, __LINE__)(name, arg)
+#else
+#define TC_TRACE_SCOPE(name) static_cast<void>(0)
+#define TC_TRACE_SCOPE_ARG(name, arg) static_cast<void>(0)
+#endif
@@ -6,6 +6,7 @@ namespace transport {
 void TransportCatalogue::AddStop(std::string id, geo::Coordinates coordinates) {
     Stop* stop = &stops_.emplace_back(Stop{std::move(id), std::move(coordinates)});
     stop_links_[stop->id] = stop;
+    ++version_;
 }
 
 StopPtr TransportCatalogue::GetStop(std::string_view id) const {
@@ -14,10 +15,12 @@ StopPtr TransportCatalogue::GetStop(std::string_view id) const {
 
 void TransportCatalogue::SetStopDistance(StopPtr stop_from, StopPtr stop_to, int distance) {    
     distances_[{stop_from, stop_to}] = distance;
+    ++version_;
 }
 
 void TransportCatalogue::SetRoutingSettings(RoutingSettings routing_settings) {
     routing_settings_ = routing_settings;
+    ++version_;
 }
 
 const RoutingSettings& TransportCatalogue::GetRoutingSettings() const {
@@ -41,6 +44,7 @@ void TransportCatalogue::AddBus(std::string id, std::vector<StopPtr> route_stops
     for (auto stop : bus->stops) {
         stop_to_buses_[stop].insert(bus);
     }
+    ++version_;
 }
 
 BusPtr TransportCatalogue::GetBus(std::string_view id) const {
@@ -78,4 +82,30 @@ const std::unordered_map<std::pair<StopPtr, StopPtr>, int, StopPairHasher>& Tran
     return distances_;
 }
 
+uint64_t TransportCatalogue::GetVersion() const {
+    return version_;
+}
+
+void TransportCatalogue::ReportMemoryUsage(memory::Report& report) const {
+    size_t stops_bytes = memory::GetHeapBytes(stops_);
+    for (const auto& stop : stops_) {
+        stops_bytes += memory::GetHeapBytes(stop.id);
+    }
+    size_t buses_bytes = memory::GetHeapBytes(buses_) + memory::GetHashTableBytes(roundtrip_buses_);
+    for (const auto& bus : buses_) {
+        buses_bytes += memory::GetHeapBytes(bus.id) + memory::GetHeapBytes(bus.stops);
+    }
+    size_t indexes_bytes = memory::GetHashTableBytes(stop_links_)
+                           + memory::GetHashTableBytes(bus_links_)
+                           + memory::GetHashTableBytes(stop_to_buses_);
+    for (const auto& [stop, buses] : stop_to_buses_) {
+        indexes_bytes += memory::GetHashTableBytes(buses);
+    }
+
+    report.Add("catalogue_stops", stops_bytes);
+    report.Add("catalogue_buses", buses_bytes);
+    report.Add("catalogue_indexes", indexes_bytes);
+    report.Add("catalogue_distances", memory::GetHashTableBytes(distances_));
+}
+
 }  // namespace transport
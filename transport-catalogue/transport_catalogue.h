@@ -1,7 +1,9 @@
 #pragma once
 #include "domain.h"
 #include "geo.h"
+#include "memory_accounting.h"
 
+#include <cstdint>
 #include <deque>
 #include <string>
 #include <unordered_map>
@@ -30,6 +32,12 @@ class TransportCatalogue {
         std::vector<StopPtr> GetStops() const;
         const std::unordered_map<std::pair<StopPtr, StopPtr>, int, StopPairHasher>& GetDistances() const;
 
+        // Номер версии данных: увеличивается при каждом изменении каталога
+        uint64_t GetVersion() const;
+
+        // Добавляет в отчёт память остановок, маршрутов, индексов и расстояний
+        void ReportMemoryUsage(memory::Report& report) const;
+
     private:
     std::deque<Stop> stops_;
     std::unordered_map<std::string_view, StopPtr> stop_links_; 
@@ -39,6 +47,7 @@ class TransportCatalogue {
     std::unordered_map<StopPtr, std::unordered_set<BusPtr>> stop_to_buses_;
     std::unordered_map<std::pair<StopPtr, StopPtr>, int, StopPairHasher> distances_;
     RoutingSettings routing_settings_;
+    uint64_t version_ = 0;
 };
 
 }  // namespace transport
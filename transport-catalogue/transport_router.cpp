@@ -1,16 +1,33 @@
 #include "transport_router.h"
 
-TransportRouter::TransportRouter(const transport::TransportCatalogue& db) :
+#include "instrumentation.h"
+
+TransportRouter::TransportRouter(const transport::TransportCatalogue& db, const memory::Budget& memory_budget) :
     db_(db)
 {
-    InitGraph();
+    {
+        TC_PHASE_SCOPE("router_init_graph");
+        InitGraph();
+    }
+    if (!memory_budget.Allows("router_table", EstimateTableMemoryUsage(db_))) {
+        dijkstra_router_ = std::make_unique<graph::DijkstraRouter<RouteTime>>(*graph_);
+        return;
+    }
+    TC_PHASE_SCOPE("router_precompute");
     router_ = std::make_unique<graph::Router<RouteTime>>(*graph_);
 }
 
+size_t TransportRouter::EstimateTableMemoryUsage(const transport::TransportCatalogue& db) {
+    // Вершины графа - остановки и точки ожидания автобуса на них (см. InitGraph)
+    return graph::Router<RouteTime>::EstimateMemoryUsage(db.GetStops().size() * 2);
+}
+
 std::optional<RouteInfo> TransportRouter::FindRoute(transport::StopPtr stop_from, 
                                                     transport::StopPtr stop_to) const {
-    auto route = router_->BuildRoute(stop_to_vertex_info_.at(stop_from).waiting_bus_vertex_id, 
-                                     stop_to_vertex_info_.at(stop_to).waiting_bus_vertex_id);
+    const auto vertex_from = stop_to_vertex_info_.at(stop_from).waiting_bus_vertex_id;
+    const auto vertex_to = stop_to_vertex_info_.at(stop_to).waiting_bus_vertex_id;
+    auto route = router_ ? router_->BuildRoute(vertex_from, vertex_to)
+                         : dijkstra_router_->BuildRoute(vertex_from, vertex_to);
     if (!route) {
         return std::nullopt;
     }
@@ -40,6 +57,17 @@ std::optional<RouteInfo> TransportRouter::FindRoute(transport::StopPtr stop_from
 
 }
 
+bool TransportRouter::IsPrecomputed() const {
+    return router_ != nullptr;
+}
+
+void TransportRouter::ReportMemoryUsage(memory::Report& report) const {
+    report.Add("router_graph", graph_->GetMemoryUsage());
+    report.Add("router_table", router_ ? router_->GetMemoryUsage() : 0);
+    report.Add("router_indexes", memory::GetHashTableBytes(stop_to_vertex_info_)
+                                 + memory::GetHashTableBytes(edge_to_bus_info_));
+}
+
 void TransportRouter::InitGraph() {
     const auto& stops = db_.GetStops();
 
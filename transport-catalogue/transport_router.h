@@ -1,6 +1,7 @@
 #pragma once
 
 #include "graph.h"
+#include "memory_accounting.h"
 #include "router.h"
 #include "transport_catalogue.h"
 
@@ -30,7 +31,12 @@ struct RouteInfo {
 
 class TransportRouter {
 public:
-    TransportRouter(const transport::TransportCatalogue& db);
+    // Если таблица кратчайших путей не укладывается в memory_budget, маршруты ищутся
+    // без предрасчёта (или бросается memory::BudgetExceededError при политике FAIL)
+    TransportRouter(const transport::TransportCatalogue& db, const memory::Budget& memory_budget = {});
+
+    // Размер таблицы кратчайших путей для каталога: известен до построения графа
+    static size_t EstimateTableMemoryUsage(const transport::TransportCatalogue& db);
 
 public:
     struct BusRouteInfo {
@@ -41,6 +47,11 @@ public:
 
     std::optional<RouteInfo> FindRoute(transport::StopPtr stop_from, transport::StopPtr stop_to) const;
 
+    // true, если маршруты берутся из предрассчитанной таблицы всех пар вершин
+    bool IsPrecomputed() const;
+
+    void ReportMemoryUsage(memory::Report& report) const;
+
 private:
     struct StopGraphVertexInfo {
         graph::VertexId waiting_bus_vertex_id;
@@ -67,6 +78,7 @@ private:
     const transport::TransportCatalogue& db_;
     std::unique_ptr<graph::DirectedWeightedGraph<RouteTime>> graph_;
     std::unique_ptr<graph::Router<RouteTime>> router_;
+    std::unique_ptr<graph::DijkstraRouter<RouteTime>> dijkstra_router_;
     std::unordered_map<transport::StopPtr, StopGraphVertexInfo> stop_to_vertex_info_;
     std::unordered_map<graph::EdgeId, GraphEdgeBusInfo> edge_to_bus_info_;
 };